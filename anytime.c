@@ -0,0 +1,97 @@
+//
+// Anytime search for one level: a solution soon, then better ones until
+// the budget runs out or the last one is known to have the fewest pushes.
+//
+// Weighted A* orders by g + w * h. With w above 1 it heads for the goals
+// and finds a solution well before plain A* would, one at most w times as
+// long as the best. The search runs again with smaller and smaller weights,
+// starting over each time, and each run cuts off every child with g + h no
+// better than the best solution so far. Since h never overestimates,
+// nothing that could beat it is cut, so a run that ends without a solution
+// proves the one before was the best, whatever its weight. So does one
+// with w = 1 that finds one.
+//
+// Starting over throws the nodes of the run before away. They were put in
+// order for the old weight, and the bound cuts much more of the next run
+// than those nodes would save: all the runs together often take less than
+// plain A* alone.
+//
+// The weights start at 2. Starting at 3 or 5 found the first solution
+// later on some of the levels tried, 20 to 30 times later on one.
+//
+// max_nodes and time_limit hold for all the runs together. Each better
+// solution goes to Solver_Options.on_solution as it comes.
+//
+
+#define ANYTIME_WEIGHT_COUNT 4
+
+// In hundredths, ending at plain A*.
+int anytime_weights[ANYTIME_WEIGHT_COUNT] = {200, 150, 120, 100};
+
+Solver_Result solve_level_anytime(Solver_Level *level, Solver_Options *options)
+{
+    Solver_Result best;
+    memset(&best, 0, sizeof(best));
+
+    double start = solver_seconds();
+    long long expanded = 0;
+    long long generated = 0;
+    int bound = SOLVER_INFINITY;
+    int runs = 0;
+    int solutions = 0;
+    int weight = 0;
+    bool gave_up = false;
+
+    for (int w = 0; w < ANYTIME_WEIGHT_COUNT; w += 1)
+    {
+        Solver_Options run_options = *options;
+
+        if (options->time_limit > 0) {
+            run_options.time_limit = options->time_limit - (solver_seconds() - start);
+            if (run_options.time_limit <= 0) {
+                gave_up = true;
+                break;
+            }
+        }
+
+        if (options->max_nodes) {
+            run_options.max_nodes = options->max_nodes - expanded;
+            if (run_options.max_nodes <= 0) {
+                gave_up = true;
+                break;
+            }
+        }
+
+        weight = anytime_weights[w];
+        Solver_Result run = solve_level_weighted(level, &run_options, weight, bound);
+        expanded += run.nodes_expanded;
+        generated += run.nodes_generated;
+        runs += 1;
+
+        if (!run.solved) {
+            gave_up = run.gave_up;
+            if (!best.solved) {
+                best = run;
+            } else {
+                free_solver_result(&run);
+            }
+            break;
+        }
+
+        free_solver_result(&best);
+        best = run;
+        bound = run.push_count;
+        solutions += 1;
+
+        if (options->on_solution) options->on_solution(options->on_solution_data, run.moves, run.push_count, solver_seconds() - start);
+    }
+
+    best.gave_up = gave_up;
+    best.nodes_expanded = expanded;
+    best.nodes_generated = generated;
+    best.anytime_runs = runs;
+    best.anytime_solutions = solutions;
+    best.anytime_weight = weight;
+    best.seconds = solver_seconds() - start;
+    return best;
+}
@@ -0,0 +1,5 @@
+@echo off
+
+pushd bin
+bench.exe %*
+popd
@@ -0,0 +1,678 @@
+#define SOKOBAN_NO_MAIN
+#include "main.c"
+
+#include <math.h>
+#include <string.h>
+
+#define MAX_BENCH_BOARDS 8
+#define MAX_BENCH_RESULTS 128
+#define MAX_REPETITIONS 100
+
+// The most a push may cost with its stuck box check. Over this it would start to show in frame time.
+#define PUSH_BUDGET_NS 2000
+
+typedef struct {
+    char name[32];
+    char filename[64];
+    bool delete_file;
+} Bench_Board;
+
+typedef struct {
+    Board board;
+    Bench_Board *source;
+
+    SDL_Renderer *renderer;
+    Game_State *game_state;
+
+    // Where the scenario placed things, so the run function can undo its own work.
+    int i, j;
+
+    int sink;
+} Bench_Context;
+
+typedef bool (*Bench_Setup)(Bench_Context *context);
+typedef void (*Bench_Run)(Bench_Context *context, int iterations);
+
+typedef struct {
+    char *name;
+    Bench_Setup setup;
+    Bench_Run run;
+    bool needs_renderer;
+
+    // Median ns/op the benchmark has to stay under, 0 for none.
+    double budget;
+} Benchmark;
+
+typedef struct {
+    char name[64];
+    char board[32];
+    int iterations;
+    int repetitions;
+    double samples[MAX_REPETITIONS];
+
+    double median;
+    double mean;
+    double stddev;
+    double min;
+
+    bool over_budget;
+} Bench_Result;
+
+typedef struct {
+    int repetitions;
+    double min_time;
+    char *filter;
+    char *out;
+    bool render;
+} Bench_Options;
+
+Bench_Board bench_boards[MAX_BENCH_BOARDS];
+int bench_board_count;
+
+Bench_Result bench_results[MAX_BENCH_RESULTS];
+int bench_result_count;
+
+Game_State bench_game_state;
+
+double get_seconds(void)
+{
+    return (double)SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+}
+
+void place_player(Board *board, int i, int j)
+{
+    Board_Cursor cursor = make_cursor(board);
+    set_player(&cursor, i, j);
+}
+
+bool is_free(Board *board, int i, int j)
+{
+    Tile tile = get_tile(board, i, j);
+    return tile_type(tile) != WALL && !tile_has_box(tile) && !tile_has_player(tile);
+}
+
+bool is_free_floor(Board *board, int i, int j)
+{
+    return is_free(board, i, j) && tile_type(get_tile(board, i, j)) == FLOOR;
+}
+
+//
+// Scenarios
+//
+
+bool setup_move(Bench_Context *context)
+{
+    Board *board = &context->board;
+
+    for (int i = 0; i < board->h; i += 1)
+    {
+        for (int j = 0; j < board->w; j += 1)
+        {
+            if (is_free(board, i, j) && is_free(board, i, j+1)) {
+                place_player(board, i, j);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void run_move(Bench_Context *context, int iterations)
+{
+    for (int n = 0; n < iterations; n += 1)
+    {
+        apply_event(make_event(MOVE, (n & 1) ? WEST : EAST), &context->board);
+    }
+}
+
+bool setup_push(Bench_Context *context)
+{
+    Board *board = &context->board;
+
+    for (int i = 0; i < board->h; i += 1)
+    {
+        for (int j = 0; j < board->w; j += 1)
+        {
+            // Plain floor only, so the push never changes goals_left and the reset below stays exact.
+            if (is_free_floor(board, i, j) && is_free_floor(board, i, j+1) && is_free_floor(board, i, j+2)) {
+                place_player(board, i, j);
+                Board_Cursor cursor = make_cursor(board);
+                set_box(&cursor, i, j+1, true);
+                context->i = i;
+                context->j = j;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void run_push(Bench_Context *context, int iterations)
+{
+    Board *board = &context->board;
+    Board_Cursor cursor = make_cursor(board);
+    int i = context->i;
+    int j = context->j;
+
+    for (int n = 0; n < iterations; n += 1)
+    {
+        apply_event(make_event(MOVE, EAST), board);
+
+        // Put the box and the player back. A handful of stores, which is noise next to the move itself.
+        set_box(&cursor, i, j+2, false);
+        set_box(&cursor, i, j+1, true);
+        set_player(&cursor, i, j);
+    }
+}
+
+bool setup_stuck_open(Bench_Context *context)
+{
+    // The box setup_push leaves out in the open, which is what most pushes look like.
+    if (!setup_push(context)) return false;
+
+    context->j += 1;
+    return true;
+}
+
+bool setup_stuck_wall(Bench_Context *context)
+{
+    // A box against a wall, so the dead square check has to walk along it.
+    Board *board = &context->board;
+
+    for (int i = 1; i < board->h; i += 1)
+    {
+        for (int j = 1; j < board->w - 1; j += 1)
+        {
+            if (is_free_floor(board, i, j) && tile_type(get_tile(board, i-1, j)) == WALL &&
+                tile_type(get_tile(board, i, j-1)) != WALL && tile_type(get_tile(board, i, j+1)) != WALL) {
+                Board_Cursor cursor = make_cursor(board);
+                set_box(&cursor, i, j, true);
+                context->i = i;
+                context->j = j;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool setup_stuck_row(Bench_Context *context)
+{
+    // A row of boxes on open floor, each one leaning on the next, so the freeze check follows them all.
+    Board *board = &context->board;
+    int length = 4;
+
+    for (int i = 0; i < board->h; i += 1)
+    {
+        for (int j = 0; j + length <= board->w; j += 1)
+        {
+            bool room = true;
+            for (int n = 0; n < length && room; n += 1)
+            {
+                room = is_free_floor(board, i, j+n) && is_free(board, i-1, j+n) && is_free(board, i+1, j+n);
+            }
+
+            if (!room) continue;
+
+            Board_Cursor cursor = make_cursor(board);
+            for (int n = 0; n < length; n += 1) set_box(&cursor, i, j+n, true);
+
+            context->i = i;
+            context->j = j;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void run_stuck_check(Bench_Context *context, int iterations)
+{
+    Board_Cursor cursor = make_cursor(&context->board);
+
+    for (int n = 0; n < iterations; n += 1)
+    {
+        context->sink += check_stuck_box(&cursor, context->i, context->j);
+    }
+}
+
+bool setup_blocked(Bench_Context *context)
+{
+    Board *board = &context->board;
+
+    for (int i = 1; i < board->h; i += 1)
+    {
+        for (int j = 0; j < board->w; j += 1)
+        {
+            if (is_free(board, i, j) && tile_type(get_tile(board, i-1, j)) == WALL) {
+                place_player(board, i, j);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void run_blocked(Bench_Context *context, int iterations)
+{
+    for (int n = 0; n < iterations; n += 1)
+    {
+        apply_event(make_event(MOVE, NORTH), &context->board);
+    }
+}
+
+bool setup_nothing(Bench_Context *context)
+{
+    (void)context;
+    return true;
+}
+
+bool setup_solved(Bench_Context *context)
+{
+    // Every goal covered. check_win_conditions only reads goals_left, which set_box keeps up to
+    // date, so this costs the same as /start and only differs in the answer.
+    Board *board = &context->board;
+    Board_Cursor cursor = make_cursor(board);
+
+    for (int i = 0; i < board->h; i += 1)
+    {
+        for (int j = 0; j < board->w; j += 1)
+        {
+            if (tile_type(read_tile(&cursor, i, j)) == GOAL) set_box(&cursor, i, j, true);
+        }
+    }
+
+    return true;
+}
+
+void run_check_win(Bench_Context *context, int iterations)
+{
+    for (int n = 0; n < iterations; n += 1)
+    {
+        context->sink += check_win_conditions(context->board);
+    }
+}
+
+Board scratch_board;
+
+void run_populate(Bench_Context *context, int iterations)
+{
+    for (int n = 0; n < iterations; n += 1)
+    {
+        context->sink += populate_board_from_file(&scratch_board, context->source->filename);
+    }
+}
+
+bool setup_render(Bench_Context *context)
+{
+    context->game_state->board = context->board;
+    context->game_state->window.x = 800;
+    context->game_state->window.y = 800;
+
+    return true;
+}
+
+void run_render(Bench_Context *context, int iterations)
+{
+    for (int n = 0; n < iterations; n += 1)
+    {
+        render_game(context->renderer, *context->game_state);
+    }
+}
+
+Benchmark benchmarks[] = {
+    {"apply_event/move",             setup_move,    run_move,      false, 0},
+    {"apply_event/push",             setup_push,    run_push,      false, PUSH_BUDGET_NS},
+    {"apply_event/blocked",          setup_blocked, run_blocked,   false, 0},
+    {"check_stuck_box/open",         setup_stuck_open, run_stuck_check, false, PUSH_BUDGET_NS},
+    {"check_stuck_box/wall",         setup_stuck_wall, run_stuck_check, false, PUSH_BUDGET_NS},
+    {"check_stuck_box/row",          setup_stuck_row,  run_stuck_check, false, PUSH_BUDGET_NS},
+    {"check_win_conditions/start",   setup_nothing, run_check_win, false, 0},
+    {"check_win_conditions/solved",  setup_solved,  run_check_win, false, 0},
+    {"populate_board_with_level",    setup_nothing, run_populate,  false, 0},
+    {"render_game",                  setup_render,  run_render,    true, 0},
+};
+
+//
+// Boards
+//
+
+// A walled rectangle with a lattice of pillars, boxes sitting one push west of their goals,
+// and the player in the top left corner.
+char synthetic_char(int w, int h, int i, int j)
+{
+    if (i == 0 || j == 0 || i == h-1 || j == w-1) return 'w';
+    if (i == 1 && j == 1) return '@';
+    if (i % 6 == 0 && j % 6 == 0) return 'w';
+    if (i % 6 == 3 && j % 6 == 3 && j + 1 < w - 1) return 'o';
+    if (i % 6 == 3 && j % 6 == 4) return 'g';
+    return '.';
+}
+
+bool write_synthetic_board(char *filename, int w, int h)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file) return false;
+
+    for (int i = 0; i < h; i += 1)
+    {
+        for (int j = 0; j < w; j += 1)
+        {
+            fputc(synthetic_char(w, h, i, j), file);
+        }
+
+        if (i < h - 1) fputc('\n', file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+void add_level_boards(void)
+{
+    for (int level = 1; bench_board_count < MAX_BENCH_BOARDS; level += 1)
+    {
+        Bench_Board *bench_board = &bench_boards[bench_board_count];
+        sprintf(bench_board->name, "level_%d", level);
+        sprintf(bench_board->filename, "../assets/levels/%d.txt", level);
+        bench_board->delete_file = false;
+
+        FILE *file = fopen(bench_board->filename, "rb");
+        if (!file) break;
+        fclose(file);
+
+        bench_board_count += 1;
+    }
+}
+
+void add_synthetic_board(int w, int h)
+{
+    if (bench_board_count == MAX_BENCH_BOARDS) return;
+
+    Bench_Board *bench_board = &bench_boards[bench_board_count];
+    sprintf(bench_board->name, "synthetic_%dx%d", w, h);
+    sprintf(bench_board->filename, "bench_%dx%d.txt", w, h);
+    bench_board->delete_file = true;
+
+    if (!write_synthetic_board(bench_board->filename, w, h)) {
+        printf("Could not write %s\n", bench_board->filename);
+        return;
+    }
+
+    bench_board_count += 1;
+}
+
+void add_file_board(char *filename)
+{
+    if (bench_board_count == MAX_BENCH_BOARDS) return;
+
+    Bench_Board *bench_board = &bench_boards[bench_board_count];
+    snprintf(bench_board->name, sizeof(bench_board->name), "%s", filename);
+    snprintf(bench_board->filename, sizeof(bench_board->filename), "%s", filename);
+    bench_board->delete_file = false;
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Could not load %s\n", filename);
+        return;
+    }
+    fclose(file);
+
+    bench_board_count += 1;
+}
+
+//
+// Measurement
+//
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(double *)a;
+    double y = *(double *)b;
+    return (x > y) - (x < y);
+}
+
+void summarize(Bench_Result *result)
+{
+    int n = result->repetitions;
+
+    double sorted[MAX_REPETITIONS];
+    memcpy(sorted, result->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+
+    result->min = sorted[0];
+    result->median = (n % 2) ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2.0;
+
+    double sum = 0;
+    for (int i = 0; i < n; i += 1) sum += sorted[i];
+    result->mean = sum / n;
+
+    double squares = 0;
+    for (int i = 0; i < n; i += 1) squares += (sorted[i] - result->mean) * (sorted[i] - result->mean);
+    result->stddev = (n > 1) ? sqrt(squares / (n - 1)) : 0;
+}
+
+double time_run(Benchmark *benchmark, Bench_Context *context, int iterations)
+{
+    double start = get_seconds();
+    benchmark->run(context, iterations);
+    return get_seconds() - start;
+}
+
+void run_benchmark(Benchmark *benchmark, Bench_Board *bench_board, Bench_Options *options, SDL_Renderer *renderer)
+{
+    if (bench_result_count == MAX_BENCH_RESULTS) return;
+
+    // A fresh board per benchmark, since the scenarios edit it.
+    static Bench_Context context;
+    if (!populate_board_from_file(&context.board, bench_board->filename)) return;
+    context.source = bench_board;
+    context.renderer = renderer;
+    context.game_state = &bench_game_state;
+    context.sink = 0;
+
+    if (!benchmark->setup(&context)) return;
+
+    // Grow the batch until one repetition takes at least min_time, so timer resolution stays out of the numbers.
+    int iterations = 1;
+    while (time_run(benchmark, &context, iterations) < options->min_time && iterations < (1 << 30))
+    {
+        iterations *= 2;
+    }
+
+    Bench_Result *result = &bench_results[bench_result_count];
+    strcpy(result->name, benchmark->name);
+    strcpy(result->board, bench_board->name);
+    result->iterations = iterations;
+    result->repetitions = options->repetitions;
+
+    for (int r = 0; r < options->repetitions; r += 1)
+    {
+        result->samples[r] = time_run(benchmark, &context, iterations) * 1e9 / iterations;
+    }
+
+    summarize(result);
+    result->over_budget = benchmark->budget > 0 && result->median > benchmark->budget;
+    bench_result_count += 1;
+
+    printf("%-30s %-20s %14.1f ns/op  (+/- %5.1f%%, min %.1f, %d x %d)%s\n",
+           result->name,
+           result->board,
+           result->median,
+           result->mean > 0 ? 100.0 * result->stddev / result->mean : 0,
+           result->min,
+           result->repetitions,
+           result->iterations,
+           result->over_budget ? "  OVER BUDGET" : "");
+}
+
+// Board names are paths from the command line, so quotes and backslashes are escaped. Control
+// characters, which paths hardly ever have, become '?' rather than escapes benchcmp does not read.
+void write_json_string(FILE *file, char *text)
+{
+    fputc('"', file);
+    for (char *c = text; *c; c += 1)
+    {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        fputc((unsigned char)*c < 0x20 ? '?' : *c, file);
+    }
+    fputc('"', file);
+}
+
+bool write_results(char *filename, Bench_Options *options)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) return false;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"unit\": \"ns/op\",\n");
+    fprintf(file, "  \"repetitions\": %d,\n", options->repetitions);
+    fprintf(file, "  \"min_time_s\": %g,\n", options->min_time);
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for (int i = 0; i < bench_result_count; i += 1)
+    {
+        Bench_Result *result = &bench_results[i];
+
+        fprintf(file, "    {\"name\": ");
+        write_json_string(file, result->name);
+        fprintf(file, ", \"board\": ");
+        write_json_string(file, result->board);
+        fprintf(file, ", \"iterations\": %d, ", result->iterations);
+        fprintf(file, "\"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, ", result->median, result->mean, result->stddev, result->min);
+        fprintf(file, "\"samples\": [");
+        for (int r = 0; r < result->repetitions; r += 1)
+        {
+            fprintf(file, r ? ", %.3f" : "%.3f", result->samples[r]);
+        }
+        fprintf(file, "]}%s\n", (i < bench_result_count - 1) ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
+
+void print_usage(void)
+{
+    printf("Usage: bench [--repetitions N] [--min-time MS] [--filter TEXT] [--out FILE] [--no-render] [--board FILE]...\n");
+}
+
+int main(int argc, char *argv[])
+{
+    Bench_Options options;
+    options.repetitions = 20;
+    options.min_time = 0.01;
+    options.filter = NULL;
+    options.out = "bench.json";
+    options.render = true;
+
+    char *board_files[MAX_BENCH_BOARDS];
+    int board_file_count = 0;
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--repetitions") && has_value) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-time") && has_value) {
+            options.min_time = atof(argv[++i]) / 1000.0;
+        } else if (!strcmp(argv[i], "--filter") && has_value) {
+            options.filter = argv[++i];
+        } else if (!strcmp(argv[i], "--out") && has_value) {
+            options.out = argv[++i];
+        } else if (!strcmp(argv[i], "--board") && has_value && board_file_count < MAX_BENCH_BOARDS) {
+            board_files[board_file_count++] = argv[++i];
+        } else if (!strcmp(argv[i], "--no-render")) {
+            options.render = false;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (options.repetitions < 1) options.repetitions = 1;
+    if (options.repetitions > MAX_REPETITIONS) options.repetitions = MAX_REPETITIONS;
+
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+
+    if (options.render) {
+        // Render offscreen: the dummy driver gives us a window surface and no display.
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+
+        if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+            printf("SDL_Init video error: %s\n", SDL_GetError());
+            return 1;
+        }
+
+        IMG_Init(IMG_INIT_PNG);
+
+        window = SDL_CreateWindow("Sokoban bench", 0, 0, 800, 800, SDL_WINDOW_HIDDEN);
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+
+        if (!renderer) {
+            printf("SDL_CreateRenderer error: %s\n", SDL_GetError());
+            return 1;
+        }
+
+        load_images(renderer);
+    } else {
+        SDL_Init(SDL_INIT_TIMER);
+    }
+
+    add_level_boards();
+    add_synthetic_board(50, 50);
+    add_synthetic_board(100, 100);
+    add_synthetic_board(1000, 1000);
+
+    for (int i = 0; i < board_file_count; i += 1)
+    {
+        add_file_board(board_files[i]);
+    }
+
+    for (int b = 0; b < bench_board_count; b += 1)
+    {
+        for (size_t i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i += 1)
+        {
+            Benchmark *benchmark = &benchmarks[i];
+
+            if (benchmark->needs_renderer && !renderer) continue;
+            if (options.filter && !strstr(benchmark->name, options.filter) && !strstr(bench_boards[b].name, options.filter)) continue;
+
+            run_benchmark(benchmark, &bench_boards[b], &options, renderer);
+        }
+    }
+
+    for (int b = 0; b < bench_board_count; b += 1)
+    {
+        if (bench_boards[b].delete_file) remove(bench_boards[b].filename);
+    }
+
+    if (!write_results(options.out, &options)) {
+        printf("Could not write %s\n", options.out);
+    } else {
+        printf("Wrote %s\n", options.out);
+    }
+
+    int over_budget = 0;
+    for (int i = 0; i < bench_result_count; i += 1)
+    {
+        if (bench_results[i].over_budget) over_budget += 1;
+    }
+
+    if (over_budget) printf("%d benchmarks over budget\n", over_budget);
+
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (window) SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return over_budget ? 1 : 0;
+}
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+//
+// Stores bench.json runs as named baselines and compares new runs against them.
+//
+//     benchcmp save NAME FILE
+//     benchcmp compare BASELINE FILE [--threshold PERCENT] [--alpha P]
+//
+// BASELINE is a saved name or a path to another bench.json. A benchmark only
+// counts as a regression when its median got slower by more than the threshold
+// AND a Mann-Whitney U test over the per-repetition samples says the shift is
+// not noise. Any regression makes the exit code non-zero.
+//
+// Baselines go in baselines/ next to the binaries, bin/baselines in the
+// repository, and are meant to be committed, so every checkout compares
+// against the same ones. A name is only a file name there: no slashes and
+// no "..".
+//
+
+#define BASELINE_DIRECTORY "baselines"
+
+typedef struct {
+    char name[64];
+    char board[64];
+    double *samples;
+    int sample_count;
+    double median;
+} Bench_Entry;
+
+typedef struct {
+    Bench_Entry *entries;
+    int entry_count;
+} Bench_Run;
+
+typedef struct {
+    char *at;
+    char *end;
+    bool failed;
+} Parser;
+
+//
+// Just enough JSON for bench.json.
+//
+
+void skip_whitespace(Parser *parser)
+{
+    while (parser->at < parser->end && (*parser->at == ' ' || *parser->at == '\n' || *parser->at == '\r' || *parser->at == '\t'))
+    {
+        parser->at += 1;
+    }
+}
+
+bool expect(Parser *parser, char c)
+{
+    skip_whitespace(parser);
+
+    if (parser->at < parser->end && *parser->at == c) {
+        parser->at += 1;
+        return true;
+    }
+
+    parser->failed = true;
+    return false;
+}
+
+bool peek(Parser *parser, char c)
+{
+    skip_whitespace(parser);
+    return parser->at < parser->end && *parser->at == c;
+}
+
+void parse_string(Parser *parser, char *out, int capacity)
+{
+    int length = 0;
+    if (!expect(parser, '"')) return;
+
+    while (parser->at < parser->end && *parser->at != '"')
+    {
+        if (*parser->at == '\\' && parser->at + 1 < parser->end) parser->at += 1;
+        if (out && length < capacity - 1) out[length++] = *parser->at;
+        parser->at += 1;
+    }
+
+    if (out) out[length] = 0;
+    expect(parser, '"');
+}
+
+double parse_number(Parser *parser)
+{
+    skip_whitespace(parser);
+
+    char *number_end;
+    double value = strtod(parser->at, &number_end);
+    if (number_end == parser->at) parser->failed = true;
+
+    parser->at = number_end;
+    return value;
+}
+
+void skip_value(Parser *parser)
+{
+    skip_whitespace(parser);
+    if (parser->at >= parser->end) {
+        parser->failed = true;
+        return;
+    }
+
+    char c = *parser->at;
+
+    if (c == '"') {
+        parse_string(parser, NULL, 0);
+    } else if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        parser->at += 1;
+
+        while (!parser->failed && !peek(parser, close))
+        {
+            if (c == '{') {
+                parse_string(parser, NULL, 0);
+                expect(parser, ':');
+            }
+            skip_value(parser);
+            if (!peek(parser, close)) expect(parser, ',');
+        }
+
+        expect(parser, close);
+    } else if (c == 't' || c == 'f' || c == 'n') {
+        while (parser->at < parser->end && *parser->at >= 'a' && *parser->at <= 'z') parser->at += 1;
+    } else {
+        parse_number(parser);
+    }
+}
+
+void parse_samples(Parser *parser, Bench_Entry *entry)
+{
+    int capacity = 16;
+    entry->samples = malloc(sizeof(double) * capacity);
+    entry->sample_count = 0;
+
+    expect(parser, '[');
+    while (!parser->failed && !peek(parser, ']'))
+    {
+        if (entry->sample_count == capacity) {
+            capacity *= 2;
+            entry->samples = realloc(entry->samples, sizeof(double) * capacity);
+        }
+
+        entry->samples[entry->sample_count++] = parse_number(parser);
+        if (!peek(parser, ']')) expect(parser, ',');
+    }
+    expect(parser, ']');
+}
+
+void parse_entry(Parser *parser, Bench_Entry *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+
+    expect(parser, '{');
+    while (!parser->failed && !peek(parser, '}'))
+    {
+        char key[64];
+        parse_string(parser, key, sizeof(key));
+        expect(parser, ':');
+
+        if (!strcmp(key, "name"))          parse_string(parser, entry->name, sizeof(entry->name));
+        else if (!strcmp(key, "board"))    parse_string(parser, entry->board, sizeof(entry->board));
+        else if (!strcmp(key, "samples"))  parse_samples(parser, entry);
+        else                               skip_value(parser);
+
+        if (!peek(parser, '}')) expect(parser, ',');
+    }
+    expect(parser, '}');
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(double *)a;
+    double y = *(double *)b;
+    return (x > y) - (x < y);
+}
+
+double median_of(double *values, int count)
+{
+    if (count == 0) return 0;
+
+    double *sorted = malloc(sizeof(double) * count);
+    memcpy(sorted, values, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), compare_doubles);
+
+    double median = (count % 2) ? sorted[count/2] : (sorted[count/2 - 1] + sorted[count/2]) / 2.0;
+    free(sorted);
+
+    return median;
+}
+
+char *read_file(char *filename, int *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = malloc(*size + 1);
+    fread(data, 1, *size, file);
+    data[*size] = 0;
+    fclose(file);
+
+    return data;
+}
+
+bool load_run(char *filename, Bench_Run *run)
+{
+    int size;
+    char *data = read_file(filename, &size);
+    if (!data) return false;
+
+    Parser parser = {data, data + size, false};
+    run->entries = NULL;
+    run->entry_count = 0;
+    int capacity = 0;
+
+    expect(&parser, '{');
+    while (!parser.failed && !peek(&parser, '}'))
+    {
+        char key[64];
+        parse_string(&parser, key, sizeof(key));
+        expect(&parser, ':');
+
+        if (!strcmp(key, "benchmarks")) {
+            expect(&parser, '[');
+            while (!parser.failed && !peek(&parser, ']'))
+            {
+                if (run->entry_count == capacity) {
+                    capacity = capacity ? capacity * 2 : 64;
+                    run->entries = realloc(run->entries, sizeof(Bench_Entry) * capacity);
+                }
+
+                Bench_Entry *entry = &run->entries[run->entry_count++];
+                parse_entry(&parser, entry);
+                entry->median = median_of(entry->samples, entry->sample_count);
+
+                if (!peek(&parser, ']')) expect(&parser, ',');
+            }
+            expect(&parser, ']');
+        } else {
+            skip_value(&parser);
+        }
+
+        if (!peek(&parser, '}')) expect(&parser, ',');
+    }
+
+    free(data);
+
+    if (parser.failed) printf("%s is not a bench.json file\n", filename);
+    return !parser.failed;
+}
+
+//
+// Statistics
+//
+
+typedef struct {
+    double value;
+    int group;
+} Ranked;
+
+int compare_ranked(const void *a, const void *b)
+{
+    return compare_doubles(&((Ranked *)a)->value, &((Ranked *)b)->value);
+}
+
+// Two sided Mann-Whitney U test, normal approximation with tie correction.
+// Returns the p-value for "both sample sets come from the same distribution".
+double mann_whitney_p(double *a, int n1, double *b, int n2)
+{
+    if (n1 < 2 || n2 < 2) return 1.0;
+
+    int n = n1 + n2;
+    Ranked *all = malloc(sizeof(Ranked) * n);
+
+    for (int i = 0; i < n1; i += 1) all[i] = (Ranked){a[i], 0};
+    for (int i = 0; i < n2; i += 1) all[n1 + i] = (Ranked){b[i], 1};
+    qsort(all, n, sizeof(Ranked), compare_ranked);
+
+    double rank_sum = 0;
+    double tie_term = 0;
+
+    int i = 0;
+    while (i < n)
+    {
+        int j = i;
+        while (j + 1 < n && all[j + 1].value == all[i].value) j += 1;
+
+        double average_rank = (i + j) / 2.0 + 1.0;
+        for (int k = i; k <= j; k += 1)
+        {
+            if (all[k].group == 0) rank_sum += average_rank;
+        }
+
+        double t = j - i + 1;
+        tie_term += t * t * t - t;
+
+        i = j + 1;
+    }
+
+    free(all);
+
+    double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * (double)n2 / 2.0;
+    double variance = n1 * (double)n2 / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+    if (variance <= 0) return 1.0;
+
+    double z = (fabs(u - mean) - 0.5) / sqrt(variance);
+    if (z < 0) z = 0;
+
+    return erfc(z / sqrt(2.0));
+}
+
+//
+// Commands
+//
+
+bool copy_file(char *from, char *to)
+{
+    int size;
+    char *data = read_file(from, &size);
+    if (!data) return false;
+
+    FILE *file = fopen(to, "wb");
+    if (!file) {
+        free(data);
+        return false;
+    }
+
+    fwrite(data, 1, size, file);
+    fclose(file);
+    free(data);
+
+    return true;
+}
+
+// Whether a name stays inside the baseline directory.
+bool valid_baseline_name(char *name)
+{
+    return name[0] && !strchr(name, '/') && !strchr(name, '\\') && !strstr(name, "..");
+}
+
+int save_baseline(char *name, char *filename)
+{
+    if (!valid_baseline_name(name)) {
+        printf("Baseline names can not contain '/', '\\' or '..': %s\n", name);
+        return 2;
+    }
+
+    Bench_Run run;
+    if (!load_run(filename, &run)) {
+        printf("Could not load %s\n", filename);
+        return 2;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.json", BASELINE_DIRECTORY, name);
+
+    make_directory(BASELINE_DIRECTORY);
+
+    if (!copy_file(filename, path)) {
+        printf("Could not write %s\n", path);
+        return 2;
+    }
+
+    printf("Saved %d benchmarks as baseline '%s' (%s)\n", run.entry_count, name, path);
+    return 0;
+}
+
+Bench_Entry *find_entry(Bench_Run *run, Bench_Entry *like)
+{
+    for (int i = 0; i < run->entry_count; i += 1)
+    {
+        if (!strcmp(run->entries[i].name, like->name) && !strcmp(run->entries[i].board, like->board)) return &run->entries[i];
+    }
+
+    return NULL;
+}
+
+int compare_runs(char *baseline, char *filename, double threshold, double alpha)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s", baseline);
+
+    Bench_Run old_run, new_run;
+
+    // Anything that is not a plain name is a path to a bench.json of its own.
+    if (valid_baseline_name(baseline)) {
+        char saved[512];
+        snprintf(saved, sizeof(saved), "%s/%s.json", BASELINE_DIRECTORY, baseline);
+
+        FILE *probe = fopen(saved, "rb");
+        if (probe) {
+            fclose(probe);
+            snprintf(path, sizeof(path), "%s", saved);
+        }
+    }
+
+    if (!load_run(path, &old_run)) {
+        printf("Could not load baseline %s\n", baseline);
+        return 2;
+    }
+
+    if (!load_run(filename, &new_run)) {
+        printf("Could not load %s\n", filename);
+        return 2;
+    }
+
+    printf("%-30s %-20s %14s %14s %9s %9s  %s\n", "benchmark", "board", "baseline", "new", "speedup", "p", "verdict");
+
+    int regressions = 0;
+
+    for (int i = 0; i < new_run.entry_count; i += 1)
+    {
+        Bench_Entry *new_entry = &new_run.entries[i];
+        Bench_Entry *old_entry = find_entry(&old_run, new_entry);
+
+        if (!old_entry) {
+            printf("%-30s %-20s %14s %14.1f %9s %9s  new\n", new_entry->name, new_entry->board, "-", new_entry->median, "-", "-");
+            continue;
+        }
+
+        double p = mann_whitney_p(old_entry->samples, old_entry->sample_count, new_entry->samples, new_entry->sample_count);
+        double speedup = new_entry->median > 0 ? old_entry->median / new_entry->median : 0;
+        double change = old_entry->median > 0 ? new_entry->median / old_entry->median - 1.0 : 0;
+
+        char *verdict = "same";
+        if (p < alpha && change > threshold) {
+            verdict = "REGRESSION";
+            regressions += 1;
+        } else if (p < alpha && change < -threshold) {
+            verdict = "faster";
+        } else if (p < alpha) {
+            verdict = "within threshold";
+        }
+
+        printf("%-30s %-20s %14.1f %14.1f %8.3fx %9.4f  %s\n",
+               new_entry->name, new_entry->board, old_entry->median, new_entry->median, speedup, p, verdict);
+    }
+
+    for (int i = 0; i < old_run.entry_count; i += 1)
+    {
+        if (!find_entry(&new_run, &old_run.entries[i])) {
+            printf("%-30s %-20s %14.1f %14s %9s %9s  missing\n", old_run.entries[i].name, old_run.entries[i].board, old_run.entries[i].median, "-", "-", "-");
+        }
+    }
+
+    printf("\n%d regression%s past %.1f%% at p < %g\n", regressions, regressions == 1 ? "" : "s", threshold * 100.0, alpha);
+
+    return regressions ? 1 : 0;
+}
+
+void print_usage(void)
+{
+    printf("Usage: benchcmp save NAME FILE\n");
+    printf("       benchcmp compare BASELINE FILE [--threshold PERCENT] [--alpha P]\n");
+    printf("Baselines are saved to %s/NAME.json, bin/%s in the repository, to be committed.\n", BASELINE_DIRECTORY, BASELINE_DIRECTORY);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 4 && !strcmp(argv[1], "save")) {
+        return save_baseline(argv[2], argv[3]);
+    }
+
+    if (argc >= 4 && !strcmp(argv[1], "compare")) {
+        double threshold = 0.05;
+        double alpha = 0.01;
+
+        for (int i = 4; i < argc; i += 1)
+        {
+            if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+                threshold = atof(argv[++i]) / 100.0;
+            } else if (!strcmp(argv[i], "--alpha") && i + 1 < argc) {
+                alpha = atof(argv[++i]);
+            } else {
+                print_usage();
+                return 2;
+            }
+        }
+
+        return compare_runs(argv[2], argv[3], threshold, alpha);
+    }
+
+    print_usage();
+    return 2;
+}
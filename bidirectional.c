@@ -0,0 +1,468 @@
+//
+// Bidirectional search for one level: A* forward by pushes from the start
+// and A* backward by pulls from the solved position, until they meet.
+//
+// A pull is a push played backwards: the player stands next to a box,
+// steps away from it and drags it along. The solved position has the boxes
+// on the goals but says nothing about the player, so the backward search
+// starts once from every region the player could be left in.
+//
+// Both sides name positions the same way, boxes plus the smallest cell of
+// the player's region, so a position one side adds is looked up in the
+// other side's table. The cheapest meeting so far is kept, and the search
+// stops once neither side has anything left with a smaller f. Each side
+// has its own bound: forward it is the solver's usual one, backward it is
+// a matching of boxes to the start cells over push distances from those
+// cells. The forward deadlock checks still hold for positions the backward
+// side makes, since a position no push sequence solves is never on a
+// solution however it was reached.
+//
+// The sides take turns in one thread, the one whose best open node has the
+// smaller f going next. That raises the lower of the two fronts, and the
+// search is over once the larger one reaches the cheapest meeting. Levels
+// with more boxes than goals have no single solved position, so they are
+// left to solve_level.
+//
+
+#define BIDIRECTIONAL_FORWARD 0
+#define BIDIRECTIONAL_BACKWARD 1
+
+typedef struct {
+    Solver_Level *level;
+    Solver_Options *options;
+
+    Transposition_Table tables[2];
+    Solver sides[2];
+
+    // distances[cell * box_count + start]: pushes to get a box from that start cell to cell.
+    int *start_distances;
+
+    // Cheapest meeting so far, and the node on each side. The backward node is -1 when the
+    // forward side reached a solved position on its own.
+    int best;
+    int meeting[2];
+
+    long long expanded[2];
+    long long generated;
+} Bidirectional_Search;
+
+// Pushes forward from each start cell, the mirror of compute_push_distances.
+int *compute_start_distances(Solver_Level *level)
+{
+    int n = level->cell_count;
+    int box_count = level->box_count;
+    int *distances = malloc(sizeof(int) * (size_t)n * box_count);
+    int *queue = malloc(sizeof(int) * n);
+
+    for (size_t c = 0; c < (size_t)n * box_count; c += 1) distances[c] = SOLVER_INFINITY;
+
+    for (int s = 0; s < box_count; s += 1)
+    {
+        int *distance = &distances[s];
+
+        int head = 0, tail = 0;
+        distance[(size_t)level->start_boxes[s] * box_count] = 0;
+        queue[tail++] = level->start_boxes[s];
+
+        while (head < tail)
+        {
+            int cell = queue[head++];
+            int pushes = distance[(size_t)cell * box_count] + 1;
+
+            for (int d = 0; d < 4; d += 1)
+            {
+                int to = cell + level->offsets[d];
+                int stand = cell - level->offsets[d];
+
+                if (level->cells[to] & SOLVER_WALL) continue;
+                if (level->cells[stand] & SOLVER_WALL) continue;
+                if (distance[(size_t)to * box_count] != SOLVER_INFINITY) continue;
+
+                distance[(size_t)to * box_count] = pushes;
+                queue[tail++] = to;
+            }
+        }
+    }
+
+    free(queue);
+    return distances;
+}
+
+int opposite_direction(int direction)
+{
+    // NORTH and SOUTH, EAST and WEST are at mirrored places in Direction.
+    return SOUTH - direction;
+}
+
+// Adds or improves a position on one side, then looks for it on the other.
+void add_bidirectional_child(Bidirectional_Search *search, int side, int parent, int *boxes, unsigned long long box_hash,
+                             int player, int from, int direction, int h)
+{
+    Solver *solver = &search->sides[side];
+    Solver *other = &search->sides[!side];
+    int g = solver->nodes[parent].g + 1;
+
+    int known_g;
+    int child = find_position(solver, box_hash, boxes, player, &known_g);
+    if (child != -1 && known_g <= g) return;
+
+    if (child == -1) child = add_node(solver, box_hash, boxes, player);
+    transposition_insert(solver->table, box_hash ^ search->level->player_keys[player], g, child, &solver->table_stats);
+
+    solver->nodes[child].parent = parent;
+    solver->nodes[child].g = g;
+    solver->nodes[child].f = g + h;
+    solver->nodes[child].box_from = from;
+    solver->nodes[child].direction = direction;
+
+    heap_push(solver, child);
+    search->generated += 1;
+
+    int other_g;
+    int met = find_position(other, box_hash, boxes, player, &other_g);
+    if (met == -1 || g + other->nodes[met].g >= search->best) return;
+
+    search->best = g + other->nodes[met].g;
+    search->meeting[side] = child;
+    search->meeting[!side] = met;
+}
+
+void expand_forward(Bidirectional_Search *search, int node, int *boxes)
+{
+    Solver_Level *level = search->level;
+    Solver *solver = &search->sides[BIDIRECTIONAL_FORWARD];
+    int g = solver->nodes[node].g;
+
+    int push_count = generate_pushes(solver, boxes, solver->nodes[node].player);
+    lower_bound(solver, boxes);
+
+    for (int p = 0; p < push_count; p += 1)
+    {
+        int b = solver->push_box[p];
+        int d = solver->push_direction[p];
+        int from = boxes[b];
+        int to = from + level->offsets[d];
+
+        int *child_boxes = solver->child_boxes;
+        memcpy(child_boxes, boxes, sizeof(int) * level->box_count);
+        child_boxes[b] = to;
+        resort_box(child_boxes, level->box_count, b);
+
+        if (push_deadlocked_child(solver, child_boxes, to)) continue;
+
+        int h = child_lower_bound(solver, boxes, b, to);
+        if (h == SOLVER_INFINITY || g + 1 + h >= search->best) continue;
+
+        unsigned long long box_hash = solver->nodes[node].box_hash ^ level->box_keys[from] ^ level->box_keys[to];
+        int player = flood_player_after_move(solver, solver->parent_reach, child_boxes, from, to, from);
+        add_bidirectional_child(search, BIDIRECTIONAL_FORWARD, node, child_boxes, box_hash, player, from, d, h);
+    }
+}
+
+// Lists the pulls the player can make from `player`'s region into the solver's push scratch.
+int generate_pulls(Solver *solver, int *boxes, int player)
+{
+    Solver_Level *level = solver->level;
+    int pull_count = 0;
+
+    flood_player(solver, boxes, player);
+    copy_bitboard(&level->bitboard, solver->parent_reach, solver->reach.reach);
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = true;
+
+    for (int b = 0; b < level->box_count; b += 1)
+    {
+        for (int d = 0; d < 4; d += 1)
+        {
+            int offset = level->offsets[d];
+            int to = boxes[b] + offset;
+            int step = to + offset;
+
+            // The player has to reach the cell the box goes to, and have room to back off into.
+            if (!player_reaches(solver, to)) continue;
+            if ((level->cells[step] & SOLVER_WALL) || solver->box_here[step]) continue;
+
+            solver->push_box[pull_count] = b;
+            solver->push_direction[pull_count] = d;
+            pull_count += 1;
+        }
+    }
+
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = false;
+
+    return pull_count;
+}
+
+void expand_backward(Bidirectional_Search *search, int node, int *boxes)
+{
+    Solver_Level *level = search->level;
+    Solver *solver = &search->sides[BIDIRECTIONAL_BACKWARD];
+    int g = solver->nodes[node].g;
+
+    int pull_count = generate_pulls(solver, boxes, solver->nodes[node].player);
+    solve_matching(&solver->matching, boxes);
+
+    for (int p = 0; p < pull_count; p += 1)
+    {
+        int b = solver->push_box[p];
+        int d = solver->push_direction[p];
+        int from = boxes[b];
+        int to = from + level->offsets[d];
+
+        int *child_boxes = solver->child_boxes;
+        memcpy(child_boxes, boxes, sizeof(int) * level->box_count);
+        child_boxes[b] = to;
+        resort_box(child_boxes, level->box_count, b);
+
+        if (push_deadlocked_child(solver, child_boxes, to)) continue;
+
+        copy_matching(&solver->child_matching, &solver->matching);
+        int h = move_matching_box(&solver->child_matching, b, to);
+        if (h == SOLVER_INFINITY || g + 1 + h >= search->best) continue;
+
+        unsigned long long box_hash = solver->nodes[node].box_hash ^ level->box_keys[from] ^ level->box_keys[to];
+        int player = flood_player_after_move(solver, solver->parent_reach, child_boxes, from, to, to + level->offsets[d]);
+        add_bidirectional_child(search, BIDIRECTIONAL_BACKWARD, node, child_boxes, box_hash, player, from, d, h);
+    }
+}
+
+// Drops heap entries a cheaper path has replaced and returns the smallest f left, or SOLVER_INFINITY.
+int bidirectional_front(Solver *solver)
+{
+    while (solver->heap_count > 0 && solver->heap[0].g != solver->nodes[solver->heap[0].node].g) heap_pop(solver);
+    return solver->heap_count > 0 ? solver->heap[0].f : SOLVER_INFINITY;
+}
+
+// The pushes from the start to the meeting, then the backward side's pulls played forwards.
+void build_bidirectional_solution(Bidirectional_Search *search, Solver_Result *result)
+{
+    Solver_Level *level = search->level;
+    Solver *forward = &search->sides[BIDIRECTIONAL_FORWARD];
+    Solver *backward = &search->sides[BIDIRECTIONAL_BACKWARD];
+
+    int forward_count = 0;
+    for (int n = search->meeting[BIDIRECTIONAL_FORWARD]; forward->nodes[n].parent != -1; n = forward->nodes[n].parent) forward_count += 1;
+
+    int backward_count = 0;
+    int meeting = search->meeting[BIDIRECTIONAL_BACKWARD];
+    if (meeting != -1) {
+        for (int n = meeting; backward->nodes[n].parent != -1; n = backward->nodes[n].parent) backward_count += 1;
+    }
+
+    int push_count = forward_count + backward_count;
+    Solver_Node *reversed = malloc(sizeof(Solver_Node) * (backward_count + 1));
+    Solver_Node **pushes = malloc(sizeof(Solver_Node *) * (push_count + 1));
+
+    int at = forward_count;
+    for (int n = search->meeting[BIDIRECTIONAL_FORWARD]; forward->nodes[n].parent != -1; n = forward->nodes[n].parent) pushes[--at] = &forward->nodes[n];
+
+    // A pull of the box on box_from one cell in `direction` undoes pushing it back from there.
+    at = forward_count;
+    for (int n = meeting; backward_count > 0 && backward->nodes[n].parent != -1; n = backward->nodes[n].parent)
+    {
+        Solver_Node *push = &reversed[at - forward_count];
+        push->box_from = backward->nodes[n].box_from + level->offsets[backward->nodes[n].direction];
+        push->direction = opposite_direction(backward->nodes[n].direction);
+        push->macro = 0;
+        push->symmetry = 0;
+        pushes[at++] = push;
+    }
+
+    build_moves(forward, pushes, push_count, result);
+
+    free(pushes);
+    free(reversed);
+}
+
+Solver_Result solve_level_bidirectional(Solver_Level *level, Solver_Options *options)
+{
+    if (level->box_count != level->goal_count) return solve_level(level, options);
+
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    double start = solver_seconds();
+
+    Bidirectional_Search search;
+    memset(&search, 0, sizeof(search));
+    search.level = level;
+    search.options = options;
+    search.best = SOLVER_INFINITY;
+    search.meeting[BIDIRECTIONAL_FORWARD] = -1;
+    search.meeting[BIDIRECTIONAL_BACKWARD] = -1;
+
+    // The two sides split the memory one search would get.
+    Solver_Options half = *options;
+    half.table_megabytes = (options->table_megabytes > 0 ? options->table_megabytes : SOLVER_DEFAULT_TABLE_MB) / 2;
+    if (half.table_megabytes < 1) half.table_megabytes = 1;
+
+    if (!init_solver_table(&search.tables[BIDIRECTIONAL_FORWARD], &half) || !init_solver_table(&search.tables[BIDIRECTIONAL_BACKWARD], &half)) {
+        free_transposition_table(&search.tables[BIDIRECTIONAL_FORWARD]);
+        free_transposition_table(&search.tables[BIDIRECTIONAL_BACKWARD]);
+        result.gave_up = true;
+        return result;
+    }
+
+    Solver *forward = &search.sides[BIDIRECTIONAL_FORWARD];
+    Solver *backward = &search.sides[BIDIRECTIONAL_BACKWARD];
+    init_solver(forward, level, &search.tables[BIDIRECTIONAL_FORWARD], options);
+    init_solver(backward, level, &search.tables[BIDIRECTIONAL_BACKWARD], options);
+
+    // The backward side is bounded by how far its boxes are from the start, not from the goals.
+    search.start_distances = compute_start_distances(level);
+    free_matching(&backward->matching);
+    free_matching(&backward->child_matching);
+    init_matching(&backward->matching, level->box_count, search.start_distances, level->box_count);
+    init_matching(&backward->child_matching, level->box_count, search.start_distances, level->box_count);
+
+    int *boxes = malloc(sizeof(int) * (level->box_count + 1));
+    memcpy(boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(boxes, level->box_count, sizeof(int), compare_ints);
+
+    int root = add_node(forward, hash_boxes(level, boxes), boxes, flood_player(forward, boxes, level->start_player));
+    forward->nodes[root].parent = -1;
+    forward->nodes[root].g = 0;
+    forward->nodes[root].f = lower_bound(forward, boxes);
+    forward->nodes[root].box_from = -1;
+    forward->nodes[root].direction = 0;
+    transposition_insert(forward->table, node_hash(forward, root), 0, root, &forward->table_stats);
+    if (forward->nodes[root].f < SOLVER_INFINITY) heap_push(forward, root);
+
+    // One backward root per region the player can be in once every box is on a goal.
+    memcpy(boxes, level->goals, sizeof(int) * level->box_count);
+    qsort(boxes, level->box_count, sizeof(int), compare_ints);
+    unsigned long long goal_hash = hash_boxes(level, boxes);
+
+    // A goal the player is sealed off from is not live, so no box ever gets onto it, and with no
+    // backward roots the search ends with no solution.
+    bool goals_live = true;
+    for (int b = 0; b < level->box_count; b += 1)
+    {
+        if (level->encoding.live_index[boxes[b]] < 0) goals_live = false;
+    }
+
+    int goal_bound = goals_live ? solve_matching(&backward->matching, boxes) : SOLVER_INFINITY;
+
+    bool *seen = calloc(level->cell_count, sizeof(bool));
+    for (int b = 0; b < level->box_count; b += 1) seen[boxes[b]] = true;
+
+    for (int cell = 0; cell < level->cell_count && goal_bound < SOLVER_INFINITY; cell += 1)
+    {
+        if (seen[cell] || (level->cells[cell] & SOLVER_WALL)) continue;
+
+        int player = flood_player(backward, boxes, cell);
+        for (int c = 0; c < level->cell_count; c += 1) if (player_reaches(backward, c)) seen[c] = true;
+
+        int node = add_node(backward, goal_hash, boxes, player);
+        backward->nodes[node].parent = -1;
+        backward->nodes[node].g = 0;
+        backward->nodes[node].f = goal_bound;
+        backward->nodes[node].box_from = -1;
+        backward->nodes[node].direction = 0;
+        transposition_insert(backward->table, node_hash(backward, node), 0, node, &backward->table_stats);
+        heap_push(backward, node);
+
+        // The start may already be solved.
+        if (same_position(forward, root, boxes, player)) {
+            search.best = 0;
+            search.meeting[BIDIRECTIONAL_FORWARD] = root;
+            search.meeting[BIDIRECTIONAL_BACKWARD] = node;
+        }
+    }
+
+    free(seen);
+    search.generated = forward->node_count + backward->node_count;
+
+    while (true)
+    {
+        int forward_f = bidirectional_front(forward);
+        int backward_f = bidirectional_front(backward);
+
+        // Either side running dry means every position it could reach was looked at.
+        if (forward->heap_count == 0 || backward->heap_count == 0) break;
+
+        // Any cheaper solution would still have a node open on both sides with f below it.
+        if (search.best <= (forward_f > backward_f ? forward_f : backward_f)) break;
+
+        long long expanded = search.expanded[BIDIRECTIONAL_FORWARD] + search.expanded[BIDIRECTIONAL_BACKWARD];
+
+        if (options->max_nodes && expanded >= options->max_nodes) {
+            result.gave_up = true;
+            break;
+        }
+
+        if (options->time_limit > 0 && (expanded & 1023) == 0 && solver_seconds() - start > options->time_limit) {
+            result.gave_up = true;
+            break;
+        }
+
+        if (solver_cancelled(options)) {
+            result.gave_up = true;
+            break;
+        }
+
+        // The side further behind goes next. Ties go forward, which has the stronger bound.
+        int side = backward_f < forward_f ? BIDIRECTIONAL_BACKWARD : BIDIRECTIONAL_FORWARD;
+        Solver *solver = &search.sides[side];
+        int node = heap_pop(solver).node;
+
+        boxes_of(solver, node, boxes);
+        search.expanded[side] += 1;
+
+        if (side == BIDIRECTIONAL_BACKWARD) {
+            expand_backward(&search, node, boxes);
+            continue;
+        }
+
+        // The table may have let go of the backward root this is, so solved positions count on their own.
+        if (is_solved_position(level, boxes)) {
+            if (forward->nodes[node].g < search.best) {
+                search.best = forward->nodes[node].g;
+                search.meeting[BIDIRECTIONAL_FORWARD] = node;
+                search.meeting[BIDIRECTIONAL_BACKWARD] = -1;
+            }
+            continue;
+        }
+
+        expand_forward(&search, node, boxes);
+    }
+
+    // A meeting found before giving up is not known to be the shortest, so it does not count, like in solve_level.
+    if (search.best < SOLVER_INFINITY && !result.gave_up) {
+        result.solved = true;
+        build_bidirectional_solution(&search, &result);
+    }
+
+    result.nodes_expanded = search.expanded[BIDIRECTIONAL_FORWARD] + search.expanded[BIDIRECTIONAL_BACKWARD];
+    result.backward_expanded = search.expanded[BIDIRECTIONAL_BACKWARD];
+    result.nodes_generated = search.generated;
+
+    long long entry_count = 0;
+    for (int side = 0; side < 2; side += 1)
+    {
+        Transposition_Stats *stats = &search.sides[side].table_stats;
+        result.table.claimed += stats->claimed;
+        result.table.inserts += stats->inserts;
+        result.table.improvements += stats->improvements;
+        result.table.duplicates += stats->duplicates;
+        result.table.replacements += stats->replacements;
+        result.table.cas_failures += stats->cas_failures;
+        add_deadlock_stats(&result.deadlocks, &search.sides[side].deadlock_stats);
+        result.reach_updates += search.sides[side].reach.updates;
+        result.reach_splits += search.sides[side].reach.splits;
+        result.reach_fills += search.sides[side].reach.fills;
+
+        result.table_bytes += search.tables[side].bytes;
+        entry_count += (long long)(search.tables[side].bucket_mask + 1) * TRANSPOSITION_BUCKET;
+    }
+    result.table_load = (double)result.table.claimed / entry_count;
+
+    free(boxes);
+    free(search.start_distances);
+    free_solver(forward);
+    free_solver(backward);
+    free_transposition_table(&search.tables[BIDIRECTIONAL_FORWARD]);
+    free_transposition_table(&search.tables[BIDIRECTIONAL_BACKWARD]);
+
+    result.seconds = solver_seconds() - start;
+    return result;
+}
@@ -0,0 +1,472 @@
+//
+// Board storage.
+//
+// The board is cut into CHUNK_SIZE x CHUNK_SIZE chunks of one byte tiles.
+// Chunks that are all wall are never stored, reads just see WALL. The rest
+// live in a fixed size LRU cache, and when the cache is full the least
+// recently used chunk is written to a scratch chunk file and read back on
+// demand. Memory goes with the part of the level that is actually in use,
+// not with its bounding box, and small levels never touch the disk.
+//
+// Go through a Board_Cursor when touching more than one tile: it remembers
+// the last chunk, so walking around one area is a compare and an index.
+//
+
+#if defined(_MSC_VER)
+#define seek_64 _fseeki64
+#else
+#define seek_64 fseeko
+#endif
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define CHUNK_TILES (CHUNK_SIZE * CHUNK_SIZE)
+
+// How much chunk data one board keeps in memory before paging to disk.
+#ifndef CHUNK_CACHE_BYTES
+#define CHUNK_CACHE_BYTES (64 * 1024 * 1024)
+#endif
+
+typedef enum {
+    FLOOR,
+    WALL,
+    GOAL,
+} Tile_Type;
+
+// Low two bits are the Tile_Type, then the flags.
+typedef unsigned char Tile;
+
+#define TILE_TYPE_MASK 3
+#define TILE_BOX (1 << 2)
+#define TILE_PLAYER (1 << 3)
+// Set on a box the game has found can never reach a goal, see stuck.c.
+#define TILE_STUCK (1 << 4)
+
+#define tile_type(tile) ((Tile_Type)((tile) & TILE_TYPE_MASK))
+#define tile_has_box(tile) (((tile) & TILE_BOX) != 0)
+#define tile_has_player(tile) (((tile) & TILE_PLAYER) != 0)
+#define tile_is_stuck(tile) (((tile) & TILE_STUCK) != 0)
+
+typedef struct {
+    long long offset;   // Where the chunk is in the chunk file, -1 if it was never written out.
+    int slot;           // Cache slot holding it, -1 if paged out.
+    bool all_wall;
+} Chunk_Entry;
+
+typedef struct {
+    Tile *tiles;        // capacity * CHUNK_TILES
+    int *owner;         // Chunk index per slot, -1 if free.
+    bool *dirty;
+
+    // LRU list through the slots, head is the most recently used.
+    int *prev;
+    int *next;
+    int head, tail;
+
+    int capacity;
+    int used;
+
+    // Bumped on every eviction so cursors know their chunk pointer may be stale.
+    unsigned int generation;
+
+    FILE *file;
+    long long file_size;
+
+    int page_ins;
+    int page_outs;
+} Chunk_Cache;
+
+typedef struct {
+    int w, h;
+    int chunks_w, chunks_h;
+
+    Chunk_Entry *chunks;
+    Chunk_Cache *cache;
+
+    int player_i, player_j;
+    int goals_left;
+
+    // Boxes the level has beyond one per goal. Those never have to reach a goal.
+    int spare_boxes;
+
+    // Boxes with TILE_STUCK. Anything but zero means the level can no longer be won.
+    int stuck_boxes;
+
+    // Zobrist hash of the box set and the player position. Equal positions have equal hashes.
+    unsigned long long hash;
+} Board;
+
+typedef struct {
+    Board *board;
+    int chunk;
+    int slot;
+    unsigned int generation;
+    Tile *tiles;
+} Board_Cursor;
+
+#define ZOBRIST_BOX 0
+#define ZOBRIST_PLAYER 1
+
+// The key for a box or the player on tile (i, j). Mixed from the coordinates instead of read
+// from a table, so it costs nothing per tile and works the same on any size of board.
+unsigned long long zobrist_key(int i, int j, int kind)
+{
+    unsigned long long x = ((((unsigned long long)(unsigned int)i) << 32) | (unsigned int)j) * 2 + kind;
+
+    // splitmix64
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void lru_unlink(Chunk_Cache *cache, int slot)
+{
+    if (cache->prev[slot] != -1) cache->next[cache->prev[slot]] = cache->next[slot];
+    else cache->head = cache->next[slot];
+
+    if (cache->next[slot] != -1) cache->prev[cache->next[slot]] = cache->prev[slot];
+    else cache->tail = cache->prev[slot];
+}
+
+void lru_push_front(Chunk_Cache *cache, int slot)
+{
+    cache->prev[slot] = -1;
+    cache->next[slot] = cache->head;
+
+    if (cache->head != -1) cache->prev[cache->head] = slot;
+    cache->head = slot;
+
+    if (cache->tail == -1) cache->tail = slot;
+}
+
+void write_chunk_out(Board *board, int slot)
+{
+    Chunk_Cache *cache = board->cache;
+    Chunk_Entry *entry = &board->chunks[cache->owner[slot]];
+
+    if (!cache->file) {
+        cache->file = tmpfile();
+
+        if (!cache->file) {
+            printf("Could not create the chunk file, the board does not fit in memory\n");
+            exit(1);
+        }
+    }
+
+    if (entry->offset == -1) {
+        entry->offset = cache->file_size;
+        cache->file_size += CHUNK_TILES;
+    }
+
+    seek_64(cache->file, entry->offset, SEEK_SET);
+    fwrite(&cache->tiles[(size_t)slot * CHUNK_TILES], 1, CHUNK_TILES, cache->file);
+
+    cache->page_outs += 1;
+}
+
+// Get a slot for `chunk`, evicting the least recently used chunk if the cache is full.
+int claim_slot(Board *board, int chunk)
+{
+    Chunk_Cache *cache = board->cache;
+    int slot;
+
+    if (cache->used < cache->capacity) {
+        slot = cache->used;
+        cache->used += 1;
+    } else {
+        slot = cache->tail;
+        lru_unlink(cache, slot);
+
+        if (cache->dirty[slot]) write_chunk_out(board, slot);
+
+        board->chunks[cache->owner[slot]].slot = -1;
+        cache->generation += 1;
+    }
+
+    cache->owner[slot] = chunk;
+    cache->dirty[slot] = false;
+    board->chunks[chunk].slot = slot;
+    lru_push_front(cache, slot);
+
+    return slot;
+}
+
+Tile *get_chunk(Board *board, int chunk, bool write)
+{
+    Chunk_Cache *cache = board->cache;
+    Chunk_Entry *entry = &board->chunks[chunk];
+
+    int slot = entry->slot;
+
+    if (slot != -1) {
+        if (cache->head != slot) {
+            lru_unlink(cache, slot);
+            lru_push_front(cache, slot);
+        }
+    } else if (entry->all_wall) {
+        static Tile walls[CHUNK_TILES];
+        if (!write) {
+            if (walls[0] != WALL) memset(walls, WALL, sizeof(walls));
+            return walls;
+        }
+
+        // Someone is writing into solid rock, so it needs real storage now.
+        slot = claim_slot(board, chunk);
+        memset(&cache->tiles[(size_t)slot * CHUNK_TILES], WALL, CHUNK_TILES);
+        entry->all_wall = false;
+    } else {
+        slot = claim_slot(board, chunk);
+        seek_64(cache->file, entry->offset, SEEK_SET);
+        fread(&cache->tiles[(size_t)slot * CHUNK_TILES], 1, CHUNK_TILES, cache->file);
+        cache->page_ins += 1;
+    }
+
+    if (write) cache->dirty[slot] = true;
+
+    return &cache->tiles[(size_t)slot * CHUNK_TILES];
+}
+
+Board_Cursor make_cursor(Board *board)
+{
+    Board_Cursor cursor;
+    cursor.board = board;
+    cursor.chunk = -1;
+    cursor.slot = -1;
+    cursor.generation = 0;
+    cursor.tiles = NULL;
+    return cursor;
+}
+
+Tile *cursor_tile(Board_Cursor *cursor, int i, int j, bool write)
+{
+    Board *board = cursor->board;
+    int chunk = (i >> CHUNK_SHIFT) * board->chunks_w + (j >> CHUNK_SHIFT);
+
+    if (chunk != cursor->chunk || cursor->generation != board->cache->generation || (write && cursor->slot == -1)) {
+        cursor->tiles = get_chunk(board, chunk, write);
+        cursor->chunk = chunk;
+        cursor->slot = board->chunks[chunk].slot;
+        cursor->generation = board->cache->generation;
+    } else if (write) {
+        board->cache->dirty[cursor->slot] = true;
+    }
+
+    return &cursor->tiles[((i & CHUNK_MASK) << CHUNK_SHIFT) + (j & CHUNK_MASK)];
+}
+
+// Anything off the board reads as wall.
+Tile read_tile(Board_Cursor *cursor, int i, int j)
+{
+    if (i < 0 || j < 0 || i >= cursor->board->h || j >= cursor->board->w) return WALL;
+    return *cursor_tile(cursor, i, j, false);
+}
+
+Tile *write_tile(Board_Cursor *cursor, int i, int j)
+{
+    return cursor_tile(cursor, i, j, true);
+}
+
+void set_box(Board_Cursor *cursor, int i, int j, bool has_box)
+{
+    Tile *tile = write_tile(cursor, i, j);
+    if (tile_has_box(*tile) == has_box) return;
+
+    if (tile_type(*tile) == GOAL) cursor->board->goals_left += has_box ? -1 : 1;
+    cursor->board->hash ^= zobrist_key(i, j, ZOBRIST_BOX);
+
+    if (tile_is_stuck(*tile)) cursor->board->stuck_boxes -= 1;
+
+    if (has_box) *tile |= TILE_BOX;
+    else *tile &= (Tile)~(TILE_BOX | TILE_STUCK);
+}
+
+void set_player(Board_Cursor *cursor, int i, int j)
+{
+    Board *board = cursor->board;
+
+    *write_tile(cursor, board->player_i, board->player_j) &= (Tile)~TILE_PLAYER;
+    *write_tile(cursor, i, j) |= TILE_PLAYER;
+
+    board->hash ^= zobrist_key(board->player_i, board->player_j, ZOBRIST_PLAYER);
+    board->hash ^= zobrist_key(i, j, ZOBRIST_PLAYER);
+
+    board->player_i = i;
+    board->player_j = j;
+}
+
+Tile get_tile(Board *board, int i, int j)
+{
+    Board_Cursor cursor = make_cursor(board);
+    return read_tile(&cursor, i, j);
+}
+
+// From scratch, touching every tile. apply_event keeps board->hash up to date without this.
+unsigned long long compute_board_hash(Board *board)
+{
+    Board_Cursor cursor = make_cursor(board);
+    unsigned long long hash = zobrist_key(board->player_i, board->player_j, ZOBRIST_PLAYER);
+
+    for (int i = 0; i < board->h; i += 1)
+    {
+        for (int j = 0; j < board->w; j += 1)
+        {
+            if (tile_has_box(read_tile(&cursor, i, j))) hash ^= zobrist_key(i, j, ZOBRIST_BOX);
+        }
+    }
+
+    return hash;
+}
+
+void free_board(Board *board)
+{
+    if (board->cache) {
+        if (board->cache->file) fclose(board->cache->file);
+
+        free(board->cache->tiles);
+        free(board->cache->owner);
+        free(board->cache->dirty);
+        free(board->cache->prev);
+        free(board->cache->next);
+        free(board->cache);
+    }
+
+    free(board->chunks);
+
+    board->chunks = NULL;
+    board->cache = NULL;
+    board->w = 0;
+    board->h = 0;
+}
+
+void init_board(Board *board, int w, int h)
+{
+    free_board(board);
+
+    board->w = w;
+    board->h = h;
+    board->chunks_w = (w + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    board->chunks_h = (h + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    board->player_i = 0;
+    board->player_j = 0;
+    board->goals_left = 0;
+    board->spare_boxes = 0;
+    board->stuck_boxes = 0;
+    board->hash = 0;
+
+    int chunk_count = board->chunks_w * board->chunks_h;
+    board->chunks = malloc(sizeof(Chunk_Entry) * chunk_count);
+
+    for (int i = 0; i < chunk_count; i += 1)
+    {
+        board->chunks[i].offset = -1;
+        board->chunks[i].slot = -1;
+        board->chunks[i].all_wall = true;
+    }
+
+    Chunk_Cache *cache = calloc(1, sizeof(Chunk_Cache));
+    cache->capacity = CHUNK_CACHE_BYTES / CHUNK_TILES;
+    if (cache->capacity > chunk_count) cache->capacity = chunk_count;
+
+    cache->tiles = malloc((size_t)cache->capacity * CHUNK_TILES);
+    cache->owner = malloc(sizeof(int) * cache->capacity);
+    cache->dirty = malloc(sizeof(bool) * cache->capacity);
+    cache->prev = malloc(sizeof(int) * cache->capacity);
+    cache->next = malloc(sizeof(int) * cache->capacity);
+    cache->head = -1;
+    cache->tail = -1;
+
+    board->cache = cache;
+}
+
+Tile tile_from_char(char c)
+{
+    switch (c) {
+        case '.': return FLOOR;
+        case 'w': return WALL;
+        case 'g': return GOAL;
+        case '@': return FLOOR | TILE_PLAYER;
+        case 'o': return FLOOR | TILE_BOX;
+        default:  return WALL;
+    }
+}
+
+typedef struct {
+    FILE *file;
+    char buffer[1 << 16];
+    int at;
+    int size;
+} Level_Reader;
+
+int next_char(Level_Reader *reader)
+{
+    if (reader->at == reader->size) {
+        reader->size = (int)fread(reader->buffer, 1, sizeof(reader->buffer), reader->file);
+        reader->at = 0;
+
+        if (reader->size == 0) return EOF;
+    }
+
+    return (unsigned char)reader->buffer[reader->at++];
+}
+
+// Reads one row into `row` (padded with wall to w), returns false at the end of the file.
+bool next_row(Level_Reader *reader, Tile *row, int w, int *length)
+{
+    int c = next_char(reader);
+    if (c == EOF) return false;
+
+    int n = 0;
+    while (c != EOF && c != '\n')
+    {
+        if (c != '\r') {
+            if (row && n < w) row[n] = tile_from_char((char)c);
+            n += 1;
+        }
+
+        c = next_char(reader);
+    }
+
+    if (row) {
+        for (int j = n; j < w; j += 1) row[j] = WALL;
+    }
+
+    if (length) *length = n;
+    return true;
+}
+
+// Copies one band of CHUNK_SIZE rows into chunks, skipping the ones that are all wall.
+void store_band(Board *board, Tile *band, int band_index)
+{
+    for (int chunk_x = 0; chunk_x < board->chunks_w; chunk_x += 1)
+    {
+        int first_j = chunk_x * CHUNK_SIZE;
+
+        bool all_wall = true;
+        for (int i = 0; i < CHUNK_SIZE && all_wall; i += 1)
+        {
+            for (int j = 0; j < CHUNK_SIZE; j += 1)
+            {
+                if (first_j + j < board->w && band[(size_t)i * board->w + first_j + j] != WALL) {
+                    all_wall = false;
+                    break;
+                }
+            }
+        }
+
+        if (all_wall) continue;
+
+        // Writing into an all wall chunk gives it storage.
+        int chunk = band_index * board->chunks_w + chunk_x;
+        Tile *tiles = get_chunk(board, chunk, true);
+
+        for (int i = 0; i < CHUNK_SIZE; i += 1)
+        {
+            for (int j = 0; j < CHUNK_SIZE; j += 1)
+            {
+                tiles[i * CHUNK_SIZE + j] = (first_j + j < board->w) ? band[(size_t)i * board->w + first_j + j] : WALL;
+            }
+        }
+    }
+}
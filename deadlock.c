@@ -0,0 +1,531 @@
+//
+// Deadlocks: positions that can no longer be solved, spotted without
+// searching below them.
+//
+//     dead squares  cells a box can never be pushed from onto any goal,
+//                   found once per level by pulling boxes back from goals
+//     freeze        the pushed box can never move again, held by walls and
+//                   by other boxes that can never move, and one of them is
+//                   off goal
+//     2x2           a square of boxes and walls with a box off goal in it
+//     wall lines    more boxes than goals on a stretch along a wall that a
+//                   box can never leave
+//     corrals       a move filter rather than a check: when the player is
+//                   shut out of an area and every push of the boxes around
+//                   it goes in (a PI-corral), only those pushes are tried
+//
+// Freeze, wall lines and corrals have a budget per call. Running out means
+// "nothing found", which is always safe. Each kind counts how often it ran,
+// how often it fired and how often it ran out of budget.
+//
+// Learning deadlocks as small windows of the board, kept in a file for
+// later levels and runs, was tried and left out. A window that loses on
+// any level is one that loses with the rest of the board left open, and
+// the checks above catch those already: over 47 levels, none of the 3364
+// different 4x4 windows around pushed boxes that got past them lost. With
+// 2x2 and freeze turned off the windows did find what those two find.
+// Looking the windows up still costs time on every push.
+//
+// Works on the solver's cell layout: SOLVER_WALL and SOLVER_GOAL flags, a
+// ring of wall around the board, and offsets indexed by Direction.
+//
+
+#define DEADLOCK_FREEZE_BUDGET 64
+#define DEADLOCK_LINE_BUDGET 256
+#define DEADLOCK_CORRAL_BUDGET 4096
+
+typedef enum {
+    DEADLOCK_DEAD_SQUARE,
+    DEADLOCK_FREEZE,
+    DEADLOCK_SQUARE,
+    DEADLOCK_WALL_LINE,
+    DEADLOCK_CORRAL,
+    DEADLOCK_KIND_COUNT,
+} Deadlock_Kind;
+
+char *deadlock_names[DEADLOCK_KIND_COUNT] = {"dead", "freeze", "2x2", "lines", "corrals"};
+
+typedef struct {
+    long long checks;
+    long long found;
+    long long over_budget;
+} Deadlock_Counter;
+
+typedef struct {
+    Deadlock_Counter kinds[DEADLOCK_KIND_COUNT];
+} Deadlock_Stats;
+
+typedef struct {
+    // Bit per Deadlock_Kind to leave out.
+    int disabled;
+
+    // 0 for the defaults above.
+    int freeze_budget;
+    int line_budget;
+    int corral_budget;
+} Deadlock_Options;
+
+typedef struct {
+    int w;
+    int cell_count;
+    unsigned char *cells;
+    int offsets[4];
+
+    bool *dead;
+
+    // Closed wall lines. cell_lines[cell * 4 + side] is the line along the wall on that side of the
+    // cell, or -1. Line l is line_cells[line_start[l]] up to line_cells[line_start[l + 1]].
+    int *cell_lines;
+    int *line_start;
+    int *line_cells;
+    int *line_goals;
+    int line_count;
+} Deadlock_Level;
+
+typedef struct {
+    // Freeze: cells that count as wall while the boxes next to them are looked at.
+    int *marks;
+    int stamp;
+    int *trail;
+    int trail_count;
+    int off_goal;
+    int budget_left;
+
+    // Corrals: which area each cell was put in, and the pushes of the best one.
+    int *areas;
+    int area_stamp;
+    int *area_queue;
+    int *corral_box;
+    int *corral_direction;
+} Deadlock_Scratch;
+
+bool deadlock_enabled(Deadlock_Options *options, Deadlock_Kind kind)
+{
+    return !(options->disabled & (1 << kind));
+}
+
+void add_deadlock_stats(Deadlock_Stats *into, Deadlock_Stats *from)
+{
+    for (int k = 0; k < DEADLOCK_KIND_COUNT; k += 1)
+    {
+        into->kinds[k].checks += from->kinds[k].checks;
+        into->kinds[k].found += from->kinds[k].found;
+        into->kinds[k].over_budget += from->kinds[k].over_budget;
+    }
+}
+
+//
+// Per level
+//
+
+void add_wall_line(Deadlock_Level *level, int first, int last, int step, int side, int *capacity)
+{
+    int length = (last - first) / step + 1;
+    int line = level->line_count++;
+
+    if (level->line_start[line] + length > *capacity) {
+        *capacity = (level->line_start[line] + length) * 2;
+        level->line_cells = realloc(level->line_cells, sizeof(int) * *capacity);
+    }
+
+    int goals = 0;
+    int at = level->line_start[line];
+    for (int cell = first; cell <= last; cell += step)
+    {
+        level->line_cells[at++] = cell;
+        level->cell_lines[cell * 4 + side] = line;
+        if (level->cells[cell] & SOLVER_GOAL) goals += 1;
+    }
+
+    level->line_goals[line] = goals;
+    level->line_start[line + 1] = at;
+}
+
+// A run of cells with wall on one side and wall at both ends. A box on it can only slide along it.
+void find_wall_lines(Deadlock_Level *level)
+{
+    int n = level->cell_count;
+    level->cell_lines = malloc(sizeof(int) * 4 * n);
+    for (int c = 0; c < 4 * n; c += 1) level->cell_lines[c] = -1;
+
+    // At most one line per cell and side.
+    level->line_start = malloc(sizeof(int) * (4 * n + 1));
+    level->line_goals = malloc(sizeof(int) * 4 * n);
+    level->line_start[0] = 0;
+
+    int capacity = 256;
+    level->line_cells = malloc(sizeof(int) * capacity);
+
+    for (int side = 0; side < 4; side += 1)
+    {
+        int wall_offset = level->offsets[side];
+        bool horizontal = side == NORTH || side == SOUTH;
+        int step = horizontal ? 1 : level->w;
+
+        for (int start = 0; start < n; start += 1)
+        {
+            if (level->cells[start] & SOLVER_WALL) continue;
+            if (!(level->cells[start + wall_offset] & SOLVER_WALL)) continue;
+            if (!(level->cells[start - step] & SOLVER_WALL)) continue;
+
+            int end = start;
+            while (!(level->cells[end + step] & SOLVER_WALL) && (level->cells[end + step + wall_offset] & SOLVER_WALL)) end += step;
+
+            if (level->cells[end + step] & SOLVER_WALL) add_wall_line(level, start, end, step, side, &capacity);
+        }
+    }
+}
+
+void build_deadlock_level(Deadlock_Level *level, unsigned char *cells, int w, int cell_count, int *offsets, int *nearest_goal)
+{
+    memset(level, 0, sizeof(*level));
+    level->w = w;
+    level->cell_count = cell_count;
+    level->cells = cells;
+    memcpy(level->offsets, offsets, sizeof(level->offsets));
+
+    level->dead = malloc(sizeof(bool) * cell_count);
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        level->dead[c] = !(cells[c] & SOLVER_WALL) && nearest_goal[c] >= SOLVER_INFINITY;
+    }
+
+    find_wall_lines(level);
+}
+
+void free_deadlock_level(Deadlock_Level *level)
+{
+    free(level->dead);
+    free(level->cell_lines);
+    free(level->line_start);
+    free(level->line_cells);
+    free(level->line_goals);
+    memset(level, 0, sizeof(*level));
+}
+
+void init_deadlock_scratch(Deadlock_Scratch *scratch, int cell_count, int box_count)
+{
+    memset(scratch, 0, sizeof(*scratch));
+    scratch->marks = calloc(cell_count, sizeof(int));
+    scratch->trail = malloc(sizeof(int) * cell_count);
+    scratch->areas = calloc(cell_count, sizeof(int));
+    scratch->area_queue = malloc(sizeof(int) * cell_count);
+    scratch->corral_box = malloc(sizeof(int) * 4 * (box_count + 1));
+    scratch->corral_direction = malloc(sizeof(int) * 4 * (box_count + 1));
+}
+
+void free_deadlock_scratch(Deadlock_Scratch *scratch)
+{
+    free(scratch->marks);
+    free(scratch->trail);
+    free(scratch->areas);
+    free(scratch->area_queue);
+    free(scratch->corral_box);
+    free(scratch->corral_direction);
+}
+
+//
+// Per push
+//
+
+bool box_frozen(Deadlock_Level *level, Deadlock_Scratch *scratch, bool *box_here, int cell);
+
+bool is_frozen_wall(Deadlock_Level *level, Deadlock_Scratch *scratch, int cell)
+{
+    return (level->cells[cell] & SOLVER_WALL) || scratch->marks[cell] == scratch->stamp;
+}
+
+// Whether the box can never move along the axis of `offset`.
+bool axis_blocked(Deadlock_Level *level, Deadlock_Scratch *scratch, bool *box_here, int cell, int offset)
+{
+    int a = cell - offset;
+    int b = cell + offset;
+
+    if (is_frozen_wall(level, scratch, a) || is_frozen_wall(level, scratch, b)) return true;
+
+    // Either way it goes it lands on a dead square, which is as good as not moving.
+    if (level->dead[a] && level->dead[b]) return true;
+
+    if (box_here[a] && box_frozen(level, scratch, box_here, a)) return true;
+    if (box_here[b] && box_frozen(level, scratch, box_here, b)) return true;
+
+    return false;
+}
+
+bool box_frozen(Deadlock_Level *level, Deadlock_Scratch *scratch, bool *box_here, int cell)
+{
+    if (scratch->budget_left <= 0) return false;
+    scratch->budget_left -= 1;
+
+    // A wall while its neighbours are looked at, so a ring of boxes does not recurse forever.
+    int trail_at = scratch->trail_count;
+    int off_goal_at = scratch->off_goal;
+    scratch->marks[cell] = scratch->stamp;
+    scratch->trail[scratch->trail_count++] = cell;
+
+    bool frozen = axis_blocked(level, scratch, box_here, cell, level->offsets[EAST]) &&
+                  axis_blocked(level, scratch, box_here, cell, level->offsets[SOUTH]);
+
+    if (!frozen) {
+        // Everything found below assumed this box could not move. It can, so none of it holds.
+        while (scratch->trail_count > trail_at) scratch->marks[scratch->trail[--scratch->trail_count]] = 0;
+        scratch->off_goal = off_goal_at;
+        return false;
+    }
+
+    if (!(level->cells[cell] & SOLVER_GOAL)) scratch->off_goal += 1;
+    return true;
+}
+
+bool freeze_deadlock(Deadlock_Level *level, Deadlock_Scratch *scratch, bool *box_here, int to, int budget, Deadlock_Counter *counter)
+{
+    counter->checks += 1;
+
+    if (scratch->stamp == 0x7fffffff) {
+        memset(scratch->marks, 0, sizeof(int) * level->cell_count);
+        scratch->stamp = 0;
+    }
+
+    scratch->stamp += 1;
+    scratch->trail_count = 0;
+    scratch->off_goal = 0;
+    scratch->budget_left = budget;
+
+    bool frozen = box_frozen(level, scratch, box_here, to);
+    if (scratch->budget_left <= 0) counter->over_budget += 1;
+
+    if (frozen && scratch->off_goal > 0) {
+        counter->found += 1;
+        return true;
+    }
+
+    return false;
+}
+
+bool square_deadlock(Deadlock_Level *level, bool *box_here, int to, Deadlock_Counter *counter)
+{
+    counter->checks += 1;
+
+    int across[2] = {-1, 1};
+    int down[2] = {-level->w, level->w};
+
+    for (int a = 0; a < 2; a += 1)
+    {
+        for (int d = 0; d < 2; d += 1)
+        {
+            int square[4] = {to, to + across[a], to + down[d], to + across[a] + down[d]};
+            bool closed = true;
+            bool off_goal = false;
+
+            for (int s = 0; s < 4 && closed; s += 1)
+            {
+                int cell = square[s];
+                if (box_here[cell]) {
+                    if (!(level->cells[cell] & SOLVER_GOAL)) off_goal = true;
+                } else if (!(level->cells[cell] & SOLVER_WALL)) {
+                    closed = false;
+                }
+            }
+
+            if (closed && off_goal) {
+                counter->found += 1;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool wall_line_deadlock(Deadlock_Level *level, bool *box_here, int to, int budget, Deadlock_Counter *counter)
+{
+    for (int side = 0; side < 4; side += 1)
+    {
+        int line = level->cell_lines[to * 4 + side];
+        if (line == -1) continue;
+
+        counter->checks += 1;
+
+        int first = level->line_start[line];
+        int last = level->line_start[line + 1];
+        if (last - first > budget) {
+            counter->over_budget += 1;
+            continue;
+        }
+
+        int boxes = 0;
+        for (int at = first; at < last; at += 1) boxes += box_here[level->line_cells[at]];
+
+        if (boxes > level->line_goals[line]) {
+            counter->found += 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Whether pushing a box onto `to` lost the level. box_here has to hold the boxes after the push.
+bool push_deadlocked(Deadlock_Level *level, Deadlock_Scratch *scratch, Deadlock_Options *options, Deadlock_Stats *stats, bool *box_here, int to)
+{
+    if (deadlock_enabled(options, DEADLOCK_DEAD_SQUARE)) {
+        stats->kinds[DEADLOCK_DEAD_SQUARE].checks += 1;
+        if (level->dead[to]) {
+            stats->kinds[DEADLOCK_DEAD_SQUARE].found += 1;
+            return true;
+        }
+    }
+
+    // Cheapest first. The 2x2 case is also a freeze, but it costs four lookups.
+    if (deadlock_enabled(options, DEADLOCK_SQUARE) && square_deadlock(level, box_here, to, &stats->kinds[DEADLOCK_SQUARE])) return true;
+
+    if (deadlock_enabled(options, DEADLOCK_WALL_LINE)) {
+        int budget = options->line_budget ? options->line_budget : DEADLOCK_LINE_BUDGET;
+        if (wall_line_deadlock(level, box_here, to, budget, &stats->kinds[DEADLOCK_WALL_LINE])) return true;
+    }
+
+    if (deadlock_enabled(options, DEADLOCK_FREEZE)) {
+        int budget = options->freeze_budget ? options->freeze_budget : DEADLOCK_FREEZE_BUDGET;
+        if (freeze_deadlock(level, scratch, box_here, to, budget, &stats->kinds[DEADLOCK_FREEZE])) return true;
+    }
+
+    return false;
+}
+
+//
+// Corrals
+//
+
+// Looks for PI-corrals around the player's region: areas the player cannot reach where every
+// push of a box on the edge goes into the area, and every box on the edge has such a push. Those
+// pushes have to happen before the area can be solved, and pushes elsewhere do not change that,
+// so trying only them loses nothing. Returns the number of pushes of the corral with the fewest,
+// left in the scratch, or 0 for none. `reachable` is the player's region, see bitboard.c.
+int find_pi_corral(Deadlock_Level *level, Deadlock_Scratch *scratch, Deadlock_Options *options, Deadlock_Stats *stats,
+                   bool *box_here, int *boxes, int box_count, Bitboard_Level *bitboard, Bitboard_Word *reachable)
+{
+    Deadlock_Counter *counter = &stats->kinds[DEADLOCK_CORRAL];
+    counter->checks += 1;
+
+    int budget = options->corral_budget ? options->corral_budget : DEADLOCK_CORRAL_BUDGET;
+    int best_count = 0;
+
+    if (scratch->area_stamp > 0x7fffffff - level->cell_count) {
+        memset(scratch->areas, 0, sizeof(int) * level->cell_count);
+        scratch->area_stamp = 0;
+    }
+
+    // Area stamps from this call are all above this one.
+    int first_stamp = scratch->area_stamp;
+
+    for (int b = 0; b < box_count; b += 1)
+    {
+        for (int d = 0; d < 4; d += 1)
+        {
+            int start = boxes[b] + level->offsets[d];
+            if (level->cells[start] & SOLVER_WALL) continue;
+            if (box_here[start] || bitboard_test(bitboard, reachable, start)) continue;
+            if (scratch->areas[start] > first_stamp) continue;
+
+            // Flood the area through empty cells and boxes alike, everything the player cannot reach.
+            int area = ++scratch->area_stamp;
+            int head = 0, tail = 0;
+            bool unsolved = false;
+
+            scratch->areas[start] = area;
+            scratch->area_queue[tail++] = start;
+
+            while (head < tail)
+            {
+                int cell = scratch->area_queue[head++];
+                bool goal = level->cells[cell] & SOLVER_GOAL;
+                if (box_here[cell] != goal) unsolved = true;
+
+                for (int n = 0; n < 4; n += 1)
+                {
+                    int next = cell + level->offsets[n];
+                    if ((level->cells[next] & SOLVER_WALL) || bitboard_test(bitboard, reachable, next)) continue;
+                    if (scratch->areas[next] == area) continue;
+
+                    scratch->areas[next] = area;
+                    scratch->area_queue[tail++] = next;
+                }
+
+                budget -= 1;
+                if (budget <= 0) {
+                    counter->over_budget += 1;
+                    if (best_count > 0) counter->found += 1;
+                    return best_count;
+                }
+            }
+
+            // Everything inside is already on goals, there is nothing to do there.
+            if (!unsolved) continue;
+
+            int push_count = 0;
+            bool pi_corral = true;
+
+            for (int e = 0; e < box_count && pi_corral; e += 1)
+            {
+                int box = boxes[e];
+                if (scratch->areas[box] != area) continue;
+
+                bool on_edge = false;
+                int pushes_in = 0;
+
+                for (int p = 0; p < 4; p += 1)
+                {
+                    int stand = box - level->offsets[p];
+                    int to = box + level->offsets[p];
+                    if (bitboard_test(bitboard, reachable, stand)) on_edge = true;
+
+                    if ((level->cells[to] & SOLVER_WALL) || box_here[to]) continue;
+                    if (!bitboard_test(bitboard, reachable, stand)) continue;
+
+                    // A push out of the area: the player has somewhere else to go, not an I-corral.
+                    if (scratch->areas[to] != area) {
+                        pi_corral = false;
+                        break;
+                    }
+
+                    pushes_in += 1;
+                }
+
+                if (!on_edge || !pi_corral) continue;
+
+                // A box on the edge the player cannot push: not a P-corral.
+                if (pushes_in == 0) {
+                    pi_corral = false;
+                    break;
+                }
+
+                push_count += pushes_in;
+            }
+
+            if (!pi_corral || push_count == 0) continue;
+            if (best_count != 0 && push_count >= best_count) continue;
+
+            best_count = 0;
+            for (int e = 0; e < box_count; e += 1)
+            {
+                int box = boxes[e];
+                if (scratch->areas[box] != area) continue;
+
+                for (int p = 0; p < 4; p += 1)
+                {
+                    int stand = box - level->offsets[p];
+                    int to = box + level->offsets[p];
+                    if ((level->cells[to] & SOLVER_WALL) || box_here[to]) continue;
+                    if (!bitboard_test(bitboard, reachable, stand)) continue;
+
+                    scratch->corral_box[best_count] = e;
+                    scratch->corral_direction[best_count] = p;
+                    best_count += 1;
+                }
+            }
+        }
+    }
+
+    if (best_count > 0) counter->found += 1;
+    return best_count;
+}
@@ -0,0 +1,695 @@
+//
+// Breadth first search on disk, for levels with more positions than memory.
+//
+// A layer is every position first reached after the same number of pushes.
+// Layers and the set of everything seen so far live in run files: records
+// sorted as bytes, each stored as how many leading bytes it shares with the
+// one before and then the rest. A record is the smallest cell of the
+// player's region, big endian, then the boxes packed as in state.c, so
+// every position has exactly one record.
+//
+// One step reads the last layer in order and collects the children in a
+// memory buffer. Whenever the buffer fills, it is sorted, deduplicated and
+// written out as a run. Then the runs are merged against the seen set in
+// one pass: a child that is not seen yet goes to the next layer and into a
+// new seen set. Every file is read and written front to back through large
+// buffers, so memory is the buffer plus one record per open file.
+//
+// Nothing remembers parents. Once a layer holds a solved position, the
+// layer before is read again to find a position with a push to it, then
+// the layer before that, back to the start.
+//
+// The files are named by the level and start position, and a state file
+// says which layer was finished last. It is written after that layer's
+// files, under a temporary name and renamed, so a run that dies anywhere
+// picks up from the last finished layer when started again on the same
+// level. The files go once the level is solved or shown unsolvable.
+//
+
+#define EXTERNAL_DEFAULT_BUFFER_MB 64
+#define EXTERNAL_IO_BUFFER (1 << 20)
+#define EXTERNAL_MAX_RUNS 1024
+#define EXTERNAL_RUN_MAGIC "SOKORUN"
+#define EXTERNAL_STATE_MAGIC "SOKOBFS"
+
+typedef struct {
+    char magic[8];
+    int record_size;
+    int reserved;
+    long long count;
+} External_Run_Header;
+
+typedef struct {
+    FILE *file;
+    int record_size;
+    unsigned char *previous;
+    long long count;
+    long long bytes;
+} Run_Writer;
+
+typedef struct {
+    FILE *file;
+    int record_size;
+    unsigned char *record;
+    long long left;
+} Run_Reader;
+
+typedef struct {
+    Solver_Level *level;
+    Solver_Options *options;
+    Solver solver;
+
+    char *directory;
+    unsigned long long key;
+
+    // Bytes of the player's cell, and of the whole record.
+    int cell_bytes;
+    int record_size;
+
+    // Children waiting to be sorted into a run.
+    unsigned char *buffer;
+    long long buffer_count;
+    long long buffer_capacity;
+    int run_count;
+
+    int *boxes;
+    unsigned char *record;
+
+    // Set when a child is solved: the child and the position it came from.
+    bool solved;
+    unsigned char *solved_record;
+    unsigned char *parent_record;
+    Solver_Node last_push;
+
+    long long expanded;
+    long long generated;
+    long long bytes_written;
+    double start;
+} External_Search;
+
+// qsort has no context pointer. The search is single threaded, so the record size goes here.
+int external_sort_size;
+
+int compare_records(const void *a, const void *b)
+{
+    return memcmp(a, b, external_sort_size);
+}
+
+//
+// Records
+//
+
+void encode_position(External_Search *search, int *boxes, int player, unsigned char *out)
+{
+    for (int byte = search->cell_bytes - 1; byte >= 0; byte -= 1)
+    {
+        *out++ = (unsigned char)((unsigned int)player >> (byte * 8));
+    }
+
+    encode_boxes(&search->level->encoding, boxes, search->level->box_count, out);
+}
+
+void decode_position(External_Search *search, unsigned char *in, int *boxes, int *player)
+{
+    unsigned int cell = 0;
+    for (int byte = 0; byte < search->cell_bytes; byte += 1) cell = (cell << 8) | *in++;
+    *player = (int)cell;
+
+    decode_boxes(&search->level->encoding, in, search->level->box_count, boxes);
+}
+
+//
+// Run files
+//
+
+bool open_run_writer(Run_Writer *writer, char *filename, int record_size)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(filename, "wb");
+    if (!writer->file) return false;
+
+    setvbuf(writer->file, NULL, _IOFBF, EXTERNAL_IO_BUFFER);
+    writer->record_size = record_size;
+    writer->previous = malloc(record_size);
+
+    // The count is not known until the end, so the header is written again then.
+    External_Run_Header header;
+    memset(&header, 0, sizeof(header));
+    writer->bytes = sizeof(header);
+    return fwrite(&header, sizeof(header), 1, writer->file) == 1;
+}
+
+void write_run_record(Run_Writer *writer, unsigned char *record)
+{
+    int shared = 0;
+    if (writer->count > 0) {
+        while (shared < writer->record_size && shared < 255 && record[shared] == writer->previous[shared]) shared += 1;
+    }
+
+    fputc(shared, writer->file);
+    fwrite(record + shared, 1, writer->record_size - shared, writer->file);
+    memcpy(writer->previous, record, writer->record_size);
+
+    writer->count += 1;
+    writer->bytes += 1 + writer->record_size - shared;
+}
+
+bool close_run_writer(Run_Writer *writer)
+{
+    External_Run_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EXTERNAL_RUN_MAGIC, sizeof(header.magic));
+    header.record_size = writer->record_size;
+    header.count = writer->count;
+
+    bool ok = !ferror(writer->file);
+    ok = ok && fseek(writer->file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, writer->file) == 1;
+    ok = fclose(writer->file) == 0 && ok;
+
+    free(writer->previous);
+    writer->file = NULL;
+    writer->previous = NULL;
+    return ok;
+}
+
+bool open_run_reader(Run_Reader *reader, char *filename, int record_size)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) return false;
+
+    setvbuf(reader->file, NULL, _IOFBF, EXTERNAL_IO_BUFFER);
+
+    External_Run_Header header;
+    bool valid = fread(&header, sizeof(header), 1, reader->file) == 1 &&
+                 !memcmp(header.magic, EXTERNAL_RUN_MAGIC, sizeof(header.magic)) &&
+                 header.record_size == record_size;
+
+    if (!valid) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return false;
+    }
+
+    reader->record_size = record_size;
+    reader->record = calloc(record_size, 1);
+    reader->left = header.count;
+    return true;
+}
+
+// Moves on to the next record. False at the end, or if the file is cut short.
+bool next_run_record(Run_Reader *reader)
+{
+    if (reader->left == 0) return false;
+
+    int shared = fgetc(reader->file);
+    if (shared < 0 || shared > reader->record_size) return false;
+
+    size_t rest = reader->record_size - shared;
+    if (fread(reader->record + shared, 1, rest, reader->file) != rest) return false;
+
+    reader->left -= 1;
+    return true;
+}
+
+void close_run_reader(Run_Reader *reader)
+{
+    if (reader->file) fclose(reader->file);
+    free(reader->record);
+    memset(reader, 0, sizeof(*reader));
+}
+
+void external_filename(External_Search *search, char *out, size_t out_size, char *kind, int number)
+{
+    snprintf(out, out_size, "%s/bfs_%016llx_%s_%04d.run", search->directory, search->key, kind, number);
+}
+
+void external_state_filename(External_Search *search, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/bfs_%016llx.state", search->directory, search->key);
+}
+
+void remove_runs(External_Search *search, int count)
+{
+    char filename[1024];
+
+    for (int r = 0; r < count; r += 1)
+    {
+        external_filename(search, filename, sizeof(filename), "run", r);
+        remove(filename);
+    }
+}
+
+// Writes `records` already sorted and unique as a run file.
+bool write_records(External_Search *search, char *filename, unsigned char *records, long long count)
+{
+    Run_Writer writer;
+    if (!open_run_writer(&writer, filename, search->record_size)) return false;
+
+    for (long long r = 0; r < count; r += 1) write_run_record(&writer, &records[r * search->record_size]);
+
+    search->bytes_written += writer.bytes;
+    return close_run_writer(&writer);
+}
+
+//
+// Layers
+//
+
+bool flush_children(External_Search *search)
+{
+    if (search->buffer_count == 0) return true;
+    if (search->run_count == EXTERNAL_MAX_RUNS) return false;
+
+    int size = search->record_size;
+    external_sort_size = size;
+    qsort(search->buffer, search->buffer_count, size, compare_records);
+
+    long long unique = 0;
+    for (long long r = 0; r < search->buffer_count; r += 1)
+    {
+        if (unique > 0 && !memcmp(&search->buffer[r * size], &search->buffer[(unique - 1) * size], size)) continue;
+        if (unique != r) memcpy(&search->buffer[unique * size], &search->buffer[r * size], size);
+        unique += 1;
+    }
+
+    char filename[1024];
+    external_filename(search, filename, sizeof(filename), "run", search->run_count);
+    search->run_count += 1;
+    search->buffer_count = 0;
+
+    return write_records(search, filename, search->buffer, unique);
+}
+
+// Calls back with every child of the position in `record` that no deadlock check rules out.
+// Returns how many there were. Stops early, returning -1, when `target` is given and found.
+int list_children(External_Search *search, unsigned char *record, unsigned char *target)
+{
+    Solver_Level *level = search->level;
+    Solver *solver = &search->solver;
+    int *boxes = search->boxes;
+    int player = 0;
+
+    decode_position(search, record, boxes, &player);
+    int push_count = generate_pushes(solver, boxes, player);
+    int child_count = 0;
+
+    for (int p = 0; p < push_count; p += 1)
+    {
+        int b = solver->push_box[p];
+        int d = solver->push_direction[p];
+        int from = boxes[b];
+        int to = from + level->offsets[d];
+
+        int *child_boxes = solver->child_boxes;
+        memcpy(child_boxes, boxes, sizeof(int) * level->box_count);
+        child_boxes[b] = to;
+        resort_box(child_boxes, level->box_count, b);
+
+        if (push_deadlocked_child(solver, child_boxes, to)) continue;
+
+        // The encoding has no room for a box that can not reach a goal any more when every box has to.
+        if (level->nearest_goal[to] >= SOLVER_INFINITY && level->box_count == level->goal_count) continue;
+
+        encode_position(search, child_boxes, flood_player_after_move(solver, solver->parent_reach, child_boxes, from, to, from), search->record);
+        child_count += 1;
+
+        if (target) {
+            if (memcmp(search->record, target, search->record_size) != 0) continue;
+
+            search->last_push.box_from = from;
+            search->last_push.direction = d;
+            return -1;
+        }
+
+        if (is_solved_position(level, child_boxes)) {
+            search->solved = true;
+            search->last_push.box_from = from;
+            search->last_push.direction = d;
+            memcpy(search->solved_record, search->record, search->record_size);
+            memcpy(search->parent_record, record, search->record_size);
+            return child_count;
+        }
+
+        if (search->buffer_count == search->buffer_capacity && !flush_children(search)) return -2;
+        memcpy(&search->buffer[search->buffer_count * search->record_size], search->record, search->record_size);
+        search->buffer_count += 1;
+    }
+
+    return child_count;
+}
+
+bool external_out_of_budget(External_Search *search)
+{
+    Solver_Options *options = search->options;
+
+    if (options->max_nodes && search->expanded >= options->max_nodes) return true;
+    if (options->time_limit > 0 && (search->expanded & 1023) == 0 && solver_seconds() - search->start > options->time_limit) return true;
+    return false;
+}
+
+// Merges the runs against the seen set of layer `depth`, writing layer depth + 1 and its seen set.
+// Returns the size of the new layer, or -1 if a file could not be read or written.
+long long merge_children(External_Search *search, int depth, long long *seen_count)
+{
+    int size = search->record_size;
+    char filename[1024];
+    bool ok = true;
+
+    Run_Reader *runs = calloc(search->run_count + 1, sizeof(Run_Reader));
+    bool *live = calloc(search->run_count + 1, sizeof(bool));
+
+    for (int r = 0; r < search->run_count; r += 1)
+    {
+        external_filename(search, filename, sizeof(filename), "run", r);
+        ok = ok && open_run_reader(&runs[r], filename, size);
+        live[r] = ok && next_run_record(&runs[r]);
+    }
+
+    Run_Reader seen;
+    external_filename(search, filename, sizeof(filename), "seen", depth);
+    ok = ok && open_run_reader(&seen, filename, size);
+    bool seen_live = ok && next_run_record(&seen);
+
+    Run_Writer layer, next_seen;
+    external_filename(search, filename, sizeof(filename), "layer", depth + 1);
+    ok = ok && open_run_writer(&layer, filename, size);
+    external_filename(search, filename, sizeof(filename), "seen", depth + 1);
+    ok = ok && open_run_writer(&next_seen, filename, size);
+
+    unsigned char *smallest = malloc(size);
+
+    while (ok)
+    {
+        // The smallest head among the runs, a linear scan since there are few of them.
+        int pick = -1;
+        for (int r = 0; r < search->run_count; r += 1)
+        {
+            if (live[r] && (pick == -1 || memcmp(runs[r].record, runs[pick].record, size) < 0)) pick = r;
+        }
+
+        if (pick == -1) break;
+        memcpy(smallest, runs[pick].record, size);
+
+        // Every run holding it moves past it, which drops the copies.
+        for (int r = 0; r < search->run_count; r += 1)
+        {
+            while (live[r] && !memcmp(runs[r].record, smallest, size)) live[r] = next_run_record(&runs[r]);
+        }
+
+        // Everything seen before it is carried over to the new seen set.
+        while (seen_live && memcmp(seen.record, smallest, size) < 0)
+        {
+            write_run_record(&next_seen, seen.record);
+            seen_live = next_run_record(&seen);
+        }
+
+        if (seen_live && !memcmp(seen.record, smallest, size)) continue;
+
+        write_run_record(&layer, smallest);
+        write_run_record(&next_seen, smallest);
+    }
+
+    while (ok && seen_live)
+    {
+        write_run_record(&next_seen, seen.record);
+        seen_live = next_run_record(&seen);
+    }
+
+    long long count = -1;
+    if (ok) {
+        // A run or the seen set that ended early was cut short on disk.
+        for (int r = 0; r < search->run_count; r += 1) ok = ok && runs[r].left == 0;
+        ok = ok && seen.left == 0;
+
+        count = layer.count;
+        *seen_count = next_seen.count;
+        search->bytes_written += layer.bytes + next_seen.bytes;
+        ok = close_run_writer(&layer) && ok;
+        ok = close_run_writer(&next_seen) && ok;
+    }
+
+    for (int r = 0; r < search->run_count; r += 1) close_run_reader(&runs[r]);
+    close_run_reader(&seen);
+    remove_runs(search, search->run_count);
+
+    free(runs);
+    free(live);
+    free(smallest);
+    search->run_count = 0;
+
+    return ok ? count : -1;
+}
+
+//
+// Progress
+//
+
+// The last finished layer, or -1 if there is no state for this level.
+int read_external_state(External_Search *search, long long *layer_count, long long *seen_count)
+{
+    char filename[1024];
+    external_state_filename(search, filename, sizeof(filename));
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) return -1;
+
+    char magic[16];
+    unsigned long long key;
+    int depth;
+    bool valid = fscanf(file, "%15s %llx %d %lld %lld", magic, &key, &depth, layer_count, seen_count) == 5 &&
+                 !strcmp(magic, EXTERNAL_STATE_MAGIC) && key == search->key && depth >= 0;
+
+    fclose(file);
+    return valid ? depth : -1;
+}
+
+bool write_external_state(External_Search *search, int depth, long long layer_count, long long seen_count)
+{
+    char filename[1024], temporary[1024 + 8];
+    external_state_filename(search, filename, sizeof(filename));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", filename);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) return false;
+
+    bool ok = fprintf(file, "%s %016llx %d %lld %lld\r\n", EXTERNAL_STATE_MAGIC, search->key, depth, layer_count, seen_count) > 0;
+    ok = fclose(file) == 0 && ok;
+
+    remove(filename);
+    if (!ok || rename(temporary, filename) != 0) {
+        remove(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+void remove_external_files(External_Search *search, int depth)
+{
+    char filename[1024];
+
+    for (int d = 0; d <= depth + 1; d += 1)
+    {
+        external_filename(search, filename, sizeof(filename), "layer", d);
+        remove(filename);
+        external_filename(search, filename, sizeof(filename), "seen", d);
+        remove(filename);
+    }
+
+    external_state_filename(search, filename, sizeof(filename));
+    remove(filename);
+}
+
+// Walks back from the solved child of layer `depth` through the layers before it.
+bool build_external_solution(External_Search *search, int depth, Solver_Result *result)
+{
+    int push_count = depth + 1;
+    Solver_Node *steps = malloc(sizeof(Solver_Node) * (push_count + 1));
+    Solver_Node **pushes = malloc(sizeof(Solver_Node *) * (push_count + 1));
+    unsigned char *target = malloc(search->record_size);
+    bool found = true;
+
+    steps[depth] = search->last_push;
+    memcpy(target, search->parent_record, search->record_size);
+
+    for (int d = depth - 1; d >= 0 && found; d -= 1)
+    {
+        char filename[1024];
+        external_filename(search, filename, sizeof(filename), "layer", d);
+
+        Run_Reader layer;
+        found = open_run_reader(&layer, filename, search->record_size);
+
+        bool parent = false;
+        while (found && !parent && next_run_record(&layer))
+        {
+            parent = list_children(search, layer.record, target) == -1;
+        }
+
+        if (parent) {
+            steps[d] = search->last_push;
+            memcpy(target, layer.record, search->record_size);
+        }
+
+        found = found && parent;
+        close_run_reader(&layer);
+    }
+
+    if (found) {
+        for (int p = 0; p < push_count; p += 1) pushes[p] = &steps[p];
+        build_moves(&search->solver, pushes, push_count, result);
+    }
+
+    free(steps);
+    free(pushes);
+    free(target);
+    return found;
+}
+
+Solver_Result solve_level_external(Solver_Level *level, Solver_Options *options)
+{
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    External_Search search;
+    memset(&search, 0, sizeof(search));
+    search.level = level;
+    search.options = options;
+    search.directory = options->external_directory ? options->external_directory : ".";
+    search.start = solver_seconds();
+    search.cell_bytes = level->cell_count <= 0x10000 ? 2 : 4;
+    search.record_size = search.cell_bytes + level->encoding.state_bytes;
+
+    long long buffer_megabytes = options->table_megabytes > 0 ? options->table_megabytes : EXTERNAL_DEFAULT_BUFFER_MB;
+    search.buffer_capacity = (buffer_megabytes << 20) / search.record_size;
+    search.buffer = malloc((size_t)search.buffer_capacity * search.record_size);
+    if (!search.buffer) {
+        result.gave_up = true;
+        return result;
+    }
+
+    // Not a transposition table, the solver only lends its scratch.
+    init_solver(&search.solver, level, NULL, options);
+    search.boxes = malloc(sizeof(int) * (level->box_count + 1));
+    search.record = malloc(search.record_size);
+    search.solved_record = malloc(search.record_size);
+    search.parent_record = malloc(search.record_size);
+
+    int *start_boxes = malloc(sizeof(int) * (level->box_count + 1));
+    memcpy(start_boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(start_boxes, level->box_count, sizeof(int), compare_ints);
+    int start_player = flood_player(&search.solver, start_boxes, level->start_player);
+    search.key = level->level_hash ^ hash_boxes(level, start_boxes) ^ level->player_keys[start_player];
+
+    long long layer_count = 1;
+    long long seen_count = 1;
+    int depth = read_external_state(&search, &layer_count, &seen_count);
+    char filename[1024];
+    bool failed = false;
+
+    if (depth >= 0) {
+        // Runs of a layer that was never finished.
+        remove_runs(&search, EXTERNAL_MAX_RUNS);
+        result.resumed_layer = depth;
+    } else {
+        // Layer 0 is the start, which is also everything seen so far.
+        depth = 0;
+        encode_position(&search, start_boxes, start_player, search.record);
+
+        external_filename(&search, filename, sizeof(filename), "layer", 0);
+        failed = !write_records(&search, filename, search.record, 1);
+        external_filename(&search, filename, sizeof(filename), "seen", 0);
+        failed = failed || !write_records(&search, filename, search.record, 1);
+        failed = failed || !write_external_state(&search, 0, 1, 1);
+    }
+
+    bool start_solved = is_solved_position(level, start_boxes);
+
+    while (!failed && !start_solved && layer_count > 0)
+    {
+        external_filename(&search, filename, sizeof(filename), "layer", depth);
+
+        Run_Reader layer;
+        if (!open_run_reader(&layer, filename, search.record_size)) {
+            failed = true;
+            break;
+        }
+
+        while (!search.solved && !result.gave_up && next_run_record(&layer))
+        {
+            if (external_out_of_budget(&search)) {
+                result.gave_up = true;
+                break;
+            }
+
+            search.expanded += 1;
+            int children = list_children(&search, layer.record, NULL);
+            if (children == -2) failed = true;
+            if (children > 0) search.generated += children;
+            if (failed) break;
+        }
+
+        if (!search.solved && !result.gave_up && layer.left != 0) failed = true;
+        close_run_reader(&layer);
+
+        if (search.solved || result.gave_up || failed) {
+            remove_runs(&search, search.run_count);
+            break;
+        }
+
+        if (!flush_children(&search)) {
+            failed = true;
+            break;
+        }
+
+        long long next_seen = 0;
+        long long next_count = merge_children(&search, depth, &next_seen);
+        if (next_count < 0 || !write_external_state(&search, depth + 1, next_count, next_seen)) {
+            failed = true;
+            break;
+        }
+
+        // The old seen set is only dropped once the state no longer points at it.
+        external_filename(&search, filename, sizeof(filename), "seen", depth);
+        remove(filename);
+
+        depth += 1;
+        layer_count = next_count;
+        seen_count = next_seen;
+    }
+
+    result.gave_up = result.gave_up || failed;
+
+    if (start_solved) {
+        result.solved = true;
+        build_moves(&search.solver, NULL, 0, &result);
+    } else if (search.solved) {
+        result.solved = build_external_solution(&search, depth, &result);
+        result.gave_up = !result.solved;
+    }
+
+    // Solved or shown unsolvable, there is nothing to pick up from.
+    if (!result.gave_up) remove_external_files(&search, depth);
+
+    result.nodes_expanded = search.expanded;
+    result.nodes_generated = search.generated;
+    result.deadlocks = search.solver.deadlock_stats;
+    result.reach_updates = search.solver.reach.updates;
+    result.reach_splits = search.solver.reach.splits;
+    result.reach_fills = search.solver.reach.fills;
+    result.external_layers = depth;
+    result.external_positions = seen_count;
+    result.external_bytes = search.bytes_written;
+
+    free(start_boxes);
+    free(search.buffer);
+    free(search.boxes);
+    free(search.record);
+    free(search.solved_record);
+    free(search.parent_record);
+    free_solver(&search.solver);
+
+    result.seconds = solver_seconds() - search.start;
+    return result;
+}
@@ -0,0 +1,369 @@
+//
+// Iterative deepening A* for one level, for searches too big to keep.
+//
+// Depth first under a bound on f, and when nothing under the bound is
+// solved, again under the smallest f that went over it. Memory is the
+// stack, one frame per push of the current line, and a transposition
+// table of fixed size, so a search can run for hours in the same space.
+//
+// The table remembers how many pushes past each position were already
+// searched without finding a solution. Reaching the position again with
+// no more than that left can not do better, so that branch is cut. The
+// count only grows as the bound does, which keeps entries good from one
+// iteration to the next. The table keeps the smallest g of a position, so
+// the count goes in as TRANSPOSITION_MAX_G minus the count. Nothing checks
+// a hit against the real boxes; the table's 64 bit keys are trusted.
+//
+// Children are tried in order of their bound, so pushes that bring a box
+// nearer a goal go first, and once one child is over the bound the rest
+// are too.
+//
+// After every iteration the next bound goes to the checkpoint file, if
+// there is one. A later run on the same position starts from there, which
+// skips the iterations already known to fail. A bound found with macros
+// may be above the fewest pushes without them, so a checkpoint written
+// with macros only resumes runs with macros. One written without them is
+// a lower bound either way.
+//
+
+#define IDA_DEFAULT_TABLE_MB 16
+#define IDA_CHECKPOINT_MAGIC "SOKOIDA"
+// Mixed into the key of checkpoints written with macros.
+#define IDA_MACROS_KEY 0x9e3779b97f4a7c15ULL
+
+typedef struct {
+    int box;
+    int direction;
+    int h;
+
+    // Where the push leaves the box and the player, and its macro and pushes, see carry_push.
+    int to;
+    int player;
+    int macro;
+    int pushes;
+} Ida_Child;
+
+typedef struct {
+    int *boxes;
+    unsigned long long box_hash;
+    int player;
+    int g;
+
+    // What the table knows the position by, see position_key.
+    unsigned long long key;
+
+    // The player's region, which the children's regions start from.
+    Bitboard_Word *reach;
+
+    Ida_Child *children;
+    int child_count;
+    int next;
+
+    // The push that led here, for build_moves.
+    Solver_Node push;
+} Ida_Frame;
+
+typedef struct {
+    Solver_Level *level;
+    Solver_Options *options;
+    Solver solver;
+    Transposition_Table table;
+
+    Ida_Frame *frames;
+    int frame_capacity;
+
+    long long expanded;
+    long long generated;
+    double start;
+} Ida_Search;
+
+Ida_Frame *ida_frame(Ida_Search *search, int depth)
+{
+    if (depth == search->frame_capacity) {
+        int capacity = search->frame_capacity ? search->frame_capacity * 2 : 64;
+        search->frames = realloc(search->frames, sizeof(Ida_Frame) * capacity);
+
+        for (int f = search->frame_capacity; f < capacity; f += 1)
+        {
+            memset(&search->frames[f], 0, sizeof(Ida_Frame));
+            search->frames[f].boxes = malloc(sizeof(int) * (search->level->box_count + 1));
+            search->frames[f].reach = make_bitboard(&search->level->bitboard);
+            search->frames[f].children = malloc(sizeof(Ida_Child) * 4 * (search->level->box_count + 1));
+        }
+
+        search->frame_capacity = capacity;
+    }
+
+    return &search->frames[depth];
+}
+
+// Lists the frame's children with their bounds, best first.
+void fill_ida_frame(Ida_Search *search, Ida_Frame *frame)
+{
+    Solver_Level *level = search->level;
+    Solver *solver = &search->solver;
+
+    int push_count = generate_pushes(solver, frame->boxes, frame->player);
+    copy_bitboard(&level->bitboard, frame->reach, solver->parent_reach);
+    lower_bound(solver, frame->boxes);
+
+    frame->child_count = 0;
+    frame->next = 0;
+
+    for (int p = 0; p < push_count; p += 1)
+    {
+        int b = solver->push_box[p];
+        int d = solver->push_direction[p];
+
+        int to, player, pushes;
+        int macro = carry_push(solver, frame->boxes, b, d, &to, &player, &pushes);
+
+        int *child_boxes = solver->child_boxes;
+        memcpy(child_boxes, frame->boxes, sizeof(int) * level->box_count);
+        child_boxes[b] = to;
+        resort_box(child_boxes, level->box_count, b);
+
+        if (push_deadlocked_child(solver, child_boxes, to)) continue;
+
+        int h = child_lower_bound(solver, frame->boxes, b, to);
+        if (h == SOLVER_INFINITY) continue;
+
+        // Insertion sort, there are only ever a few dozen. By f, which only differs from h with macros.
+        int at = frame->child_count++;
+        while (at > 0 && frame->children[at - 1].pushes + frame->children[at - 1].h > pushes + h)
+        {
+            frame->children[at] = frame->children[at - 1];
+            at -= 1;
+        }
+
+        frame->children[at].box = b;
+        frame->children[at].direction = d;
+        frame->children[at].h = h;
+        frame->children[at].to = to;
+        frame->children[at].player = player;
+        frame->children[at].macro = macro;
+        frame->children[at].pushes = pushes;
+    }
+
+    search->expanded += 1;
+    search->generated += frame->child_count;
+}
+
+// Whether the position was already searched with at least `budget` pushes to go. Marks it if not.
+bool ida_seen(Ida_Search *search, unsigned long long hash, int budget)
+{
+    Solver *solver = &search->solver;
+
+    int stored;
+    unsigned int unused;
+    if (transposition_lookup(&search->table, hash, &stored, &unused) && TRANSPOSITION_MAX_G - stored >= budget) {
+        solver->table_stats.duplicates += 1;
+        return true;
+    }
+
+    transposition_insert(&search->table, hash, TRANSPOSITION_MAX_G - budget, 0, &solver->table_stats);
+    return false;
+}
+
+// Which position a checkpoint is for: the level's cells and the start, together, and whether it was
+// searched with macros.
+unsigned long long ida_position_key(Solver_Level *level, Ida_Frame *root, bool macros)
+{
+    unsigned long long key = level->level_hash ^ root->box_hash ^ level->player_keys[root->player];
+    return macros ? key ^ IDA_MACROS_KEY : key;
+}
+
+// With macros, a checkpoint written without them is taken too.
+int read_ida_checkpoint(char *filename, unsigned long long key, bool macros)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) return 0;
+
+    char magic[16];
+    unsigned long long file_key;
+    int bound;
+    bool valid = fscanf(file, "%15s %llx %d", magic, &file_key, &bound) == 3 && !strcmp(magic, IDA_CHECKPOINT_MAGIC) &&
+                 (file_key == key || (macros && file_key == (key ^ IDA_MACROS_KEY)));
+
+    fclose(file);
+    return valid ? bound : 0;
+}
+
+// Written under a temporary name and renamed, like the pattern databases, so a run killed while
+// writing leaves the last checkpoint.
+void write_ida_checkpoint(char *filename, unsigned long long key, int bound, long long expanded)
+{
+    char temporary[1024];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", filename);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) return;
+
+    bool ok = fprintf(file, "%s %016llx %d %lld\r\n", IDA_CHECKPOINT_MAGIC, key, bound, expanded) > 0;
+    ok = fclose(file) == 0 && ok;
+
+    remove(filename);
+    if (!ok || rename(temporary, filename) != 0) remove(temporary);
+}
+
+bool ida_out_of_budget(Ida_Search *search)
+{
+    Solver_Options *options = search->options;
+
+    if (options->max_nodes && search->expanded >= options->max_nodes) return true;
+    if (options->time_limit > 0 && (search->expanded & 1023) == 0 && solver_seconds() - search->start > options->time_limit) return true;
+    if (solver_cancelled(options)) return true;
+    return false;
+}
+
+// Starts at `first_bound` when that is above the lower bound of the start, see replay_parallel_solution.
+Solver_Result solve_level_ida_from(Solver_Level *level, Solver_Options *options, int first_bound)
+{
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    Ida_Search search;
+    memset(&search, 0, sizeof(search));
+    search.level = level;
+    search.options = options;
+    search.start = solver_seconds();
+
+    long long table_megabytes = options->table_megabytes > 0 ? options->table_megabytes : IDA_DEFAULT_TABLE_MB;
+    if (!init_transposition_table(&search.table, table_megabytes << 20)) {
+        result.gave_up = true;
+        return result;
+    }
+
+    Solver *solver = &search.solver;
+    init_solver(solver, level, &search.table, options);
+
+    Ida_Frame *root = ida_frame(&search, 0);
+    memcpy(root->boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(root->boxes, level->box_count, sizeof(int), compare_ints);
+    root->box_hash = hash_boxes(level, root->boxes);
+    root->player = flood_player(solver, root->boxes, level->start_player);
+    root->key = position_key(solver, root->boxes, root->box_hash, root->player);
+    root->g = 0;
+
+    unsigned long long key = ida_position_key(level, root, options->macros);
+    int bound = lower_bound(solver, root->boxes);
+    if (first_bound > bound) bound = first_bound;
+
+    if (options->checkpoint_file) {
+        int resumed = read_ida_checkpoint(options->checkpoint_file, key, options->macros);
+        if (resumed > bound) {
+            bound = resumed;
+            result.resumed_bound = resumed;
+        }
+    }
+
+    int solved_depth = -1;
+    if (is_solved_position(level, root->boxes)) solved_depth = 0;
+
+    while (solved_depth == -1 && bound < SOLVER_INFINITY && !result.gave_up)
+    {
+        int next_bound = SOLVER_INFINITY;
+        result.iterations += 1;
+
+        root = ida_frame(&search, 0);
+        ida_seen(&search, root->key, bound);
+        fill_ida_frame(&search, root);
+        int depth = 0;
+
+        while (depth >= 0)
+        {
+            Ida_Frame *frame = &search.frames[depth];
+            if (frame->next == frame->child_count) {
+                depth -= 1;
+                continue;
+            }
+
+            Ida_Child child = frame->children[frame->next++];
+            int g = frame->g + child.pushes;
+
+            if (g + child.h > bound) {
+                if (g + child.h < next_bound) next_bound = g + child.h;
+                frame->next = frame->child_count;
+                continue;
+            }
+
+            if (ida_out_of_budget(&search)) {
+                result.gave_up = true;
+                break;
+            }
+
+            // The frame pointer does not survive a new frame being made.
+            Ida_Frame *next = ida_frame(&search, depth + 1);
+            frame = &search.frames[depth];
+
+            int from = frame->boxes[child.box];
+            int to = child.to;
+
+            memcpy(next->boxes, frame->boxes, sizeof(int) * level->box_count);
+            next->boxes[child.box] = to;
+            resort_box(next->boxes, level->box_count, child.box);
+            next->box_hash = frame->box_hash ^ level->box_keys[from] ^ level->box_keys[to];
+            next->player = flood_player_after_push(solver, frame->reach, next->boxes, from, to, child.player, child.macro);
+            next->key = position_key(solver, next->boxes, next->box_hash, next->player);
+            next->g = g;
+            next->push.box_from = from;
+            next->push.direction = child.direction;
+            next->push.macro = child.macro;
+
+            if (ida_seen(&search, next->key, bound - g)) continue;
+
+            if (is_solved_position(level, next->boxes)) {
+                solved_depth = depth + 1;
+                break;
+            }
+
+            fill_ida_frame(&search, next);
+            depth += 1;
+        }
+
+        if (solved_depth != -1 || result.gave_up) break;
+
+        bound = next_bound;
+        if (options->checkpoint_file && bound < SOLVER_INFINITY) write_ida_checkpoint(options->checkpoint_file, key, bound, search.expanded);
+    }
+
+    if (solved_depth != -1) {
+        result.solved = true;
+
+        Solver_Node **pushes = malloc(sizeof(Solver_Node *) * (solved_depth + 1));
+        for (int d = 1; d <= solved_depth; d += 1) pushes[d - 1] = &search.frames[d].push;
+        build_moves(solver, pushes, solved_depth, &result);
+        free(pushes);
+    }
+
+    result.nodes_expanded = search.expanded;
+    result.nodes_generated = search.generated;
+    result.table = solver->table_stats;
+    result.table_bytes = search.table.bytes;
+    result.table_load = transposition_load(&search.table, solver->table_stats.claimed);
+    result.deadlocks = solver->deadlock_stats;
+    result.reach_updates = solver->reach.updates;
+    result.reach_splits = solver->reach.splits;
+    result.reach_fills = solver->reach.fills;
+    result.tunnel_runs = solver->tunnel_runs;
+    result.room_fills = solver->room_fills;
+    result.final_bound = bound;
+
+    for (int f = 0; f < search.frame_capacity; f += 1)
+    {
+        free(search.frames[f].boxes);
+        free(search.frames[f].reach);
+        free(search.frames[f].children);
+    }
+    free(search.frames);
+    free_solver(solver);
+    free_transposition_table(&search.table);
+
+    result.seconds = solver_seconds() - search.start;
+    return result;
+}
+
+Solver_Result solve_level_ida(Solver_Level *level, Solver_Options *options)
+{
+    return solve_level_ida_from(level, options, 0);
+}
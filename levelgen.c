@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+//
+// Generates big levels in the game's format, for scaling tests.
+//
+// The board is a grid of rooms joined by doors. Every room is 7x5 inside
+// a one tile wall:
+//
+//     .......
+//     .og.og.
+//     .......
+//     .og.og.
+//     .......
+//
+// Each box sits one push west of its goal and the tile west of the box is
+// always free, and the free rows and columns keep every room connected no
+// matter which boxes have been pushed, so the level is solvable by
+// construction. The seed picks which slots hold boxes and which doors exist.
+//
+
+#define ROOM_W 7
+#define ROOM_H 5
+#define SLOTS_PER_ROOM 4
+
+#define DOOR_EAST  (1 << 4)
+#define DOOR_SOUTH (1 << 5)
+
+typedef struct {
+    int w, h;
+    int rooms_x, rooms_y;
+
+    // Low four bits: which box slots are used. Then the door bits.
+    unsigned char *rooms;
+} Layout;
+
+unsigned long long rng_state;
+
+unsigned long long next_random(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+int random_below(int n)
+{
+    return (int)(next_random() % (unsigned long long)n);
+}
+
+void carve_doors(Layout *layout, int extra_door_percent)
+{
+    int room_count = layout->rooms_x * layout->rooms_y;
+
+    // Random depth first spanning tree, so every room is reachable.
+    bool *visited = calloc(room_count, sizeof(bool));
+    int *stack = malloc(sizeof(int) * room_count);
+    int top = 0;
+
+    stack[top++] = 0;
+    visited[0] = true;
+
+    while (top > 0)
+    {
+        int room = stack[top-1];
+        int x = room % layout->rooms_x;
+        int y = room / layout->rooms_x;
+
+        int neighbours[4];
+        int neighbour_count = 0;
+
+        if (x > 0 && !visited[room-1])                                   neighbours[neighbour_count++] = room-1;
+        if (x < layout->rooms_x-1 && !visited[room+1])                   neighbours[neighbour_count++] = room+1;
+        if (y > 0 && !visited[room-layout->rooms_x])                     neighbours[neighbour_count++] = room-layout->rooms_x;
+        if (y < layout->rooms_y-1 && !visited[room+layout->rooms_x])     neighbours[neighbour_count++] = room+layout->rooms_x;
+
+        if (neighbour_count == 0) {
+            top -= 1;
+            continue;
+        }
+
+        int next = neighbours[random_below(neighbour_count)];
+
+        if (next == room+1)                    layout->rooms[room] |= DOOR_EAST;
+        else if (next == room-1)               layout->rooms[next] |= DOOR_EAST;
+        else if (next == room+layout->rooms_x) layout->rooms[room] |= DOOR_SOUTH;
+        else                                   layout->rooms[next] |= DOOR_SOUTH;
+
+        visited[next] = true;
+        stack[top++] = next;
+    }
+
+    // Some extra doors make loops, so it is not all dead ends.
+    for (int room = 0; room < room_count; room += 1)
+    {
+        int x = room % layout->rooms_x;
+        int y = room / layout->rooms_x;
+
+        if (x < layout->rooms_x-1 && random_below(100) < extra_door_percent) layout->rooms[room] |= DOOR_EAST;
+        if (y < layout->rooms_y-1 && random_below(100) < extra_door_percent) layout->rooms[room] |= DOOR_SOUTH;
+    }
+
+    free(visited);
+    free(stack);
+}
+
+void place_boxes(Layout *layout, int boxes)
+{
+    int slot_count = layout->rooms_x * layout->rooms_y * SLOTS_PER_ROOM;
+    int *slots = malloc(sizeof(int) * slot_count);
+
+    for (int i = 0; i < slot_count; i += 1) slots[i] = i;
+
+    // Partial Fisher-Yates: the first `boxes` entries are a uniform pick.
+    for (int i = 0; i < boxes; i += 1)
+    {
+        int j = i + random_below(slot_count - i);
+        int swap = slots[i];
+        slots[i] = slots[j];
+        slots[j] = swap;
+
+        layout->rooms[slots[i] / SLOTS_PER_ROOM] |= 1 << (slots[i] % SLOTS_PER_ROOM);
+    }
+
+    free(slots);
+}
+
+char cell_at(Layout *layout, int i, int j)
+{
+    if (i == 0 || j == 0) return 'w';
+
+    int room_x = (j-1) / (ROOM_W+1);
+    int room_y = (i-1) / (ROOM_H+1);
+    if (room_x >= layout->rooms_x || room_y >= layout->rooms_y) return 'w';
+
+    int local_x = (j-1) % (ROOM_W+1);
+    int local_y = (i-1) % (ROOM_H+1);
+    unsigned char room = layout->rooms[room_y * layout->rooms_x + room_x];
+
+    if (local_x == ROOM_W) {
+        return (local_y == 2 && (room & DOOR_EAST)) ? '.' : 'w';
+    }
+
+    if (local_y == ROOM_H) {
+        return (local_x == 3 && (room & DOOR_SOUTH)) ? '.' : 'w';
+    }
+
+    if (room_x == 0 && room_y == 0 && local_x == 0 && local_y == 0) return '@';
+
+    if (local_y == 1 || local_y == 3) {
+        int slot = (local_y == 1 ? 0 : 2) + (local_x >= 3 ? 1 : 0);
+        bool used = room & (1 << slot);
+
+        if (used && (local_x == 1 || local_x == 4)) return 'o';
+        if (used && (local_x == 2 || local_x == 5)) return 'g';
+    }
+
+    return '.';
+}
+
+void print_usage(void)
+{
+    printf("Usage: levelgen WIDTH HEIGHT BOXES [--seed N] [--doors PERCENT] [--out FILE]\n");
+    printf("Examples:\n");
+    printf("  levelgen 100 100 10 --out big_100.txt\n");
+    printf("  levelgen 1000 1000 10000 --seed 7 --out big_1000.txt\n");
+    printf("  levelgen 4000 4000 100000 --out big_4000.txt\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4) {
+        print_usage();
+        return 1;
+    }
+
+    Layout layout;
+    layout.w = atoi(argv[1]);
+    layout.h = atoi(argv[2]);
+    int boxes = atoi(argv[3]);
+
+    unsigned long long seed = 1;
+    int extra_door_percent = 25;
+    char *out = NULL;
+
+    for (int i = 4; i < argc; i += 1)
+    {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--doors") && i + 1 < argc) {
+            extra_door_percent = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    layout.rooms_x = (layout.w - 1) / (ROOM_W+1);
+    layout.rooms_y = (layout.h - 1) / (ROOM_H+1);
+
+    if (layout.rooms_x < 1 || layout.rooms_y < 1) {
+        printf("Board must be at least %dx%d\n", ROOM_W+2, ROOM_H+2);
+        return 1;
+    }
+
+    long long capacity = (long long)layout.rooms_x * layout.rooms_y * SLOTS_PER_ROOM;
+    if (boxes < 1 || boxes > capacity) {
+        printf("A %dx%d board holds between 1 and %lld boxes\n", layout.w, layout.h, capacity);
+        return 1;
+    }
+
+    // Zero would get xorshift stuck.
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    layout.rooms = calloc(layout.rooms_x * layout.rooms_y, 1);
+    carve_doors(&layout, extra_door_percent);
+    place_boxes(&layout, boxes);
+
+    FILE *file = out ? fopen(out, "wb") : stdout;
+    if (!file) {
+        printf("Could not open %s\n", out);
+        return 1;
+    }
+
+    // One row at a time, so memory only grows with the number of rooms.
+    char *row = malloc(layout.w + 1);
+
+    for (int i = 0; i < layout.h; i += 1)
+    {
+        for (int j = 0; j < layout.w; j += 1)
+        {
+            row[j] = cell_at(&layout, i, j);
+        }
+
+        fwrite(row, 1, layout.w, file);
+        if (i < layout.h - 1) fputc('\n', file);
+    }
+
+    if (out) {
+        fclose(file);
+        printf("Wrote %s: %dx%d, %d boxes, seed %llu\n", out, layout.w, layout.h, boxes, seed);
+    }
+
+    free(row);
+    free(layout.rooms);
+
+    return 0;
+}
@@ -0,0 +1,530 @@
+//
+// Macro moves: runs of pushes the search makes in one step.
+//
+//     tunnels     a box pushed onto a cell with wall on both sides of it,
+//                 across the push, and no goal, keeps going the same way
+//                 while the next cell is free and not dead
+//     goal rooms  goals behind a one-wide doorway, with no box in there
+//                 at the start, are filled in a fixed order: a box pushed
+//                 through the doorway goes straight on to the next goal
+//
+// Both are found once per level. A room's order comes from taking the
+// boxes back out of it full, by pulls, the one nearest the doorway first,
+// so the first box in goes to the goal the last one came out of. The pulls
+// that took a box out, undone, are the pushes that take it in.
+//
+// A macro costs every push in it, so the lower bounds still hold. But the
+// positions part way through one are never searched, and a solution that
+// needs one of them, or a room filled in another order, is missed. That
+// makes them an option (Solver_Options.macros) rather than the default,
+// for levels where finding a solution soon matters more than the fewest
+// pushes.
+//
+// Works on the solver's cell layout, like deadlock.c.
+//
+
+// Rooms bigger than this are left alone: taking the boxes out searches pairs of cells in them.
+#define MACRO_MAX_ROOM_CELLS 256
+
+
+typedef struct {
+    int entrance;
+    // The way a box goes through the entrance into the room.
+    int direction;
+
+    // In the order they are filled, and the path that fills each.
+    int *goals;
+    int *paths;
+    int goal_count;
+} Goal_Room;
+
+typedef struct {
+    // Bit per Direction a box pushed onto the cell that way keeps going.
+    unsigned char *tunnel;
+    int tunnel_cells;
+
+    // Room per cell, -1 outside every room, and the room behind each entrance, -1 for none.
+    int *room_of;
+    int *entrance_of;
+
+    Goal_Room *rooms;
+    int room_count;
+
+    // Path p is pushes path_start[p] up to path_start[p + 1], each the box's cell and a Direction.
+    int *path_start;
+    int *path_from;
+    int *path_direction;
+    int path_count;
+    int path_capacity;
+    int push_capacity;
+} Macro_Level;
+
+// Taking the boxes out of one room. Its cells, its entrance and the cell outside that are numbered
+// from 0 in `local`, and the search is over the box's number and the smallest number of the
+// player's region.
+typedef struct {
+    unsigned char *cells;
+    int *offsets;
+
+    int *local;
+    int *cell_of;
+    int count;
+    bool *filled;
+
+    int *state_parent;
+    int *state_queue;
+    int *region_mark;
+    int region_stamp;
+    int *region_queue;
+} Macro_Build;
+
+// The two directions across `direction`.
+void across_directions(int direction, int *a, int *b)
+{
+    if (direction == NORTH || direction == SOUTH) {
+        *a = WEST;
+        *b = EAST;
+    } else {
+        *a = NORTH;
+        *b = SOUTH;
+    }
+}
+
+bool cell_has_box(int *boxes, int box_count, int cell)
+{
+    for (int b = 0; b < box_count; b += 1) if (boxes[b] == cell) return true;
+    return false;
+}
+
+//
+// Goal rooms
+//
+
+// Marks the player's region from `start`, around the filled goals and `box`, in BFS order in the
+// region queue, and returns its smallest number.
+int macro_region(Macro_Build *build, int start, int box)
+{
+    build->region_stamp += 1;
+    int smallest = start;
+    int head = 0, tail = 0;
+    build->region_mark[start] = build->region_stamp;
+    build->region_queue[tail++] = start;
+
+    while (head < tail)
+    {
+        int at = build->region_queue[head++];
+        if (at < smallest) smallest = at;
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int next = build->local[build->cell_of[at] + build->offsets[d]];
+            if (next == -1 || next == box || build->filled[next] || build->region_mark[next] == build->region_stamp) continue;
+
+            build->region_mark[next] = build->region_stamp;
+            build->region_queue[tail++] = next;
+        }
+    }
+
+    return smallest;
+}
+
+void start_macro_path(Macro_Level *macros)
+{
+    if (macros->path_count + 2 > macros->path_capacity) {
+        macros->path_capacity = (macros->path_count + 2) * 2;
+        macros->path_start = realloc(macros->path_start, sizeof(int) * macros->path_capacity);
+    }
+
+    macros->path_start[macros->path_count + 1] = macros->path_start[macros->path_count];
+}
+
+void append_macro_push(Macro_Level *macros, int from, int direction)
+{
+    int at = macros->path_start[macros->path_count + 1]++;
+    if (at == macros->push_capacity) {
+        macros->push_capacity = macros->push_capacity ? macros->push_capacity * 2 : 64;
+        macros->path_from = realloc(macros->path_from, sizeof(int) * macros->push_capacity);
+        macros->path_direction = realloc(macros->path_direction, sizeof(int) * macros->push_capacity);
+    }
+
+    macros->path_from[at] = from;
+    macros->path_direction[at] = direction;
+}
+
+// Pulls the box on `goal` out onto the entrance, breadth first, with the filled goals staying put
+// and the player starting anywhere it can get to from outside. Keeps the pushes that bring it back
+// in as a new path and returns its number, or -1 if the box can not get out.
+int pull_out_of_room(Macro_Level *macros, Macro_Build *build, int goal, int entrance, int outside)
+{
+    int count = build->count;
+    for (int s = 0; s < count * count; s += 1) build->state_parent[s] = -1;
+
+    int start = goal * count + macro_region(build, outside, goal);
+    build->state_parent[start] = start;
+
+    int head = 0, tail = 0;
+    build->state_queue[tail++] = start;
+    int found = -1;
+
+    while (head < tail && found == -1)
+    {
+        int state = build->state_queue[head++];
+        int box = state / count;
+
+        // Where the player can stand next to the box, read before the children's regions are marked.
+        int stands[4];
+        macro_region(build, state % count, box);
+        for (int d = 0; d < 4; d += 1)
+        {
+            int stand = build->local[build->cell_of[box] + build->offsets[d]];
+            stands[d] = stand != -1 && build->region_mark[stand] == build->region_stamp ? stand : -1;
+        }
+
+        for (int d = 0; d < 4 && found == -1; d += 1)
+        {
+            // The player steps on away from the box and the box follows it.
+            if (stands[d] == -1) continue;
+
+            int step = build->local[build->cell_of[stands[d]] + build->offsets[d]];
+            if (step == -1 || build->filled[step]) continue;
+
+            int next = stands[d] * count + macro_region(build, step, stands[d]);
+            if (build->state_parent[next] != -1) continue;
+
+            build->state_parent[next] = state;
+            build->state_queue[tail++] = next;
+            if (stands[d] == entrance) found = next;
+        }
+    }
+
+    if (found == -1) return -1;
+
+    // Back from the way out meets the pulls last first, which is the order of the pushes undoing them.
+    start_macro_path(macros);
+    for (int state = found; build->state_parent[state] != state; state = build->state_parent[state])
+    {
+        int from = build->cell_of[state / count];
+        int to = build->cell_of[build->state_parent[state] / count];
+
+        int direction = NORTH;
+        for (int d = 0; d < 4; d += 1) if (build->offsets[d] == to - from) direction = d;
+        append_macro_push(macros, from, direction);
+    }
+
+    return macros->path_count++;
+}
+
+// Finds the order the room's goals can be filled in, and the path for each, or returns false.
+bool plan_goal_room(Macro_Level *macros, Macro_Build *build, Goal_Room *room, int *room_cells, int room_cell_count)
+{
+    build->count = 0;
+    for (int c = 0; c < room_cell_count; c += 1) build->cell_of[build->count++] = room_cells[c];
+
+    int entrance = build->count;
+    build->cell_of[build->count++] = room->entrance;
+    int outside = build->count;
+    build->cell_of[build->count++] = room->entrance - build->offsets[room->direction];
+
+    for (int i = 0; i < build->count; i += 1)
+    {
+        build->local[build->cell_of[i]] = i;
+        build->filled[i] = false;
+    }
+
+    // Nearest the entrance first, which are the first tried to come out and so the last filled.
+    macro_region(build, entrance, -1);
+    int *candidates = malloc(sizeof(int) * build->count);
+    int candidate_count = 0;
+    for (int i = 0; i < build->count; i += 1)
+    {
+        int at = build->region_queue[i];
+        if (build->cells[build->cell_of[at]] & SOLVER_GOAL) candidates[candidate_count++] = at;
+    }
+    for (int g = 0; g < candidate_count; g += 1) build->filled[candidates[g]] = true;
+
+    int first_path = macros->path_count;
+    room->goal_count = candidate_count;
+    bool planned = true;
+
+    for (int k = candidate_count - 1; k >= 0 && planned; k -= 1)
+    {
+        planned = false;
+        for (int g = 0; g < candidate_count && !planned; g += 1)
+        {
+            int goal = candidates[g];
+            if (!build->filled[goal]) continue;
+
+            build->filled[goal] = false;
+            int path = pull_out_of_room(macros, build, goal, entrance, outside);
+            if (path == -1) {
+                build->filled[goal] = true;
+                continue;
+            }
+
+            room->goals[k] = build->cell_of[goal];
+            room->paths[k] = path;
+            planned = true;
+        }
+    }
+
+    for (int i = 0; i < build->count; i += 1) build->local[build->cell_of[i]] = -1;
+    free(candidates);
+
+    if (!planned) macros->path_count = first_path;
+    return planned;
+}
+
+// Looks for a room behind the doorway `entrance`, going in `direction`, and plans it. Leaves it out
+// if the other side can be reached round it, or it has no goal, a box to start with, too many
+// cells, or overlaps a room already found.
+void find_goal_room(Macro_Level *macros, Macro_Build *build, int entrance, int direction, int *start_boxes, int box_count,
+                    int *room_cells, int *mark, int stamp)
+{
+    unsigned char *cells = build->cells;
+    int *offsets = build->offsets;
+
+    int count = 0, head = 0;
+    bool has_goal = false;
+    mark[entrance] = stamp;
+    mark[entrance + offsets[direction]] = stamp;
+    room_cells[count++] = entrance + offsets[direction];
+
+    while (head < count)
+    {
+        int cell = room_cells[head++];
+        if (cell == entrance - offsets[direction] || macros->room_of[cell] != -1 || macros->entrance_of[cell] != -1) return;
+        if (cell_has_box(start_boxes, box_count, cell)) return;
+        if (cells[cell] & SOLVER_GOAL) has_goal = true;
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int next = cell + offsets[d];
+            if ((cells[next] & SOLVER_WALL) || mark[next] == stamp) continue;
+            if (count == MACRO_MAX_ROOM_CELLS) return;
+
+            mark[next] = stamp;
+            room_cells[count++] = next;
+        }
+    }
+
+    if (!has_goal) return;
+
+    macros->rooms = realloc(macros->rooms, sizeof(Goal_Room) * (macros->room_count + 1));
+    Goal_Room *room = &macros->rooms[macros->room_count];
+    room->entrance = entrance;
+    room->direction = direction;
+    room->goals = malloc(sizeof(int) * count);
+    room->paths = malloc(sizeof(int) * count);
+
+    if (!plan_goal_room(macros, build, room, room_cells, count)) {
+        free(room->goals);
+        free(room->paths);
+        return;
+    }
+
+    for (int c = 0; c < count; c += 1) macros->room_of[room_cells[c]] = macros->room_count;
+    macros->entrance_of[entrance] = macros->room_count;
+    macros->room_count += 1;
+}
+
+//
+// Per level
+//
+
+void build_macro_level(Macro_Level *macros, unsigned char *cells, int cell_count, int *offsets, bool *dead,
+                       int *start_boxes, int box_count)
+{
+    memset(macros, 0, sizeof(*macros));
+    macros->tunnel = calloc(cell_count, 1);
+    macros->room_of = malloc(sizeof(int) * cell_count);
+    macros->entrance_of = malloc(sizeof(int) * cell_count);
+    macros->path_capacity = 16;
+    macros->path_start = calloc(macros->path_capacity, sizeof(int));
+
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        macros->room_of[c] = -1;
+        macros->entrance_of[c] = -1;
+    }
+
+    // Tunnels: a box can only go on along them, or back.
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        if (cells[c] & (SOLVER_WALL | SOLVER_GOAL) || dead[c]) continue;
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int a, b;
+            across_directions(d, &a, &b);
+            if (!(cells[c + offsets[a]] & SOLVER_WALL) || !(cells[c + offsets[b]] & SOLVER_WALL)) continue;
+
+            int next = c + offsets[d];
+            if ((cells[next] & SOLVER_WALL) || dead[next] || (cells[c - offsets[d]] & SOLVER_WALL)) continue;
+
+            macros->tunnel[c] |= 1 << d;
+        }
+
+        if (macros->tunnel[c]) macros->tunnel_cells += 1;
+    }
+
+    // Goal rooms: a doorway the width of one cell, the one innermost in a corridor, with the
+    // room its only way through.
+    Macro_Build build;
+    int most = MACRO_MAX_ROOM_CELLS + 2;
+    build.cells = cells;
+    build.offsets = offsets;
+    build.local = malloc(sizeof(int) * cell_count);
+    build.cell_of = malloc(sizeof(int) * most);
+    build.filled = malloc(sizeof(bool) * most);
+    build.state_parent = malloc(sizeof(int) * most * most);
+    build.state_queue = malloc(sizeof(int) * most * most);
+    build.region_mark = calloc(most, sizeof(int));
+    build.region_stamp = 0;
+    build.region_queue = malloc(sizeof(int) * most);
+    for (int c = 0; c < cell_count; c += 1) build.local[c] = -1;
+
+    int *room_cells = malloc(sizeof(int) * (MACRO_MAX_ROOM_CELLS + 1));
+    int *mark = calloc(cell_count, sizeof(int));
+    int stamp = 0;
+
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        if (cells[c] & (SOLVER_WALL | SOLVER_GOAL)) continue;
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int a, b;
+            across_directions(d, &a, &b);
+            if (!(cells[c + offsets[a]] & SOLVER_WALL) || !(cells[c + offsets[b]] & SOLVER_WALL)) continue;
+
+            int inside = c + offsets[d];
+            if ((cells[inside] & SOLVER_WALL) || (cells[c - offsets[d]] & SOLVER_WALL)) continue;
+            if ((cells[inside + offsets[a]] & SOLVER_WALL) && (cells[inside + offsets[b]] & SOLVER_WALL)) continue;
+            if (macros->entrance_of[c] != -1 || macros->room_of[c] != -1) continue;
+
+            stamp += 1;
+            find_goal_room(macros, &build, c, d, start_boxes, box_count, room_cells, mark, stamp);
+        }
+    }
+
+    free(room_cells);
+    free(mark);
+    free(build.local);
+    free(build.cell_of);
+    free(build.filled);
+    free(build.state_parent);
+    free(build.state_queue);
+    free(build.region_mark);
+    free(build.region_queue);
+}
+
+void free_macro_level(Macro_Level *macros)
+{
+    for (int r = 0; r < macros->room_count; r += 1)
+    {
+        free(macros->rooms[r].goals);
+        free(macros->rooms[r].paths);
+    }
+
+    free(macros->rooms);
+    free(macros->tunnel);
+    free(macros->room_of);
+    free(macros->entrance_of);
+    free(macros->path_start);
+    free(macros->path_from);
+    free(macros->path_direction);
+    memset(macros, 0, sizeof(*macros));
+}
+
+//
+// Per push
+//
+
+// How many of the room's goals are filled, if its boxes are on the first that many of them and
+// one more can go in, else -1.
+int room_fill(Macro_Level *macros, int room, int *boxes, int box_count)
+{
+    Goal_Room *goal_room = &macros->rooms[room];
+
+    int inside = 0;
+    for (int b = 0; b < box_count; b += 1) if (macros->room_of[boxes[b]] == room) inside += 1;
+    if (inside >= goal_room->goal_count) return -1;
+
+    for (int b = 0; b < box_count; b += 1)
+    {
+        if (macros->room_of[boxes[b]] != room) continue;
+
+        bool in_order = false;
+        for (int k = 0; k < inside; k += 1) if (goal_room->goals[k] == boxes[b]) in_order = true;
+        if (!in_order) return -1;
+    }
+
+    return inside;
+}
+
+// Where a box pushed from `from` in `direction` ends up once the macros have carried it on, with
+// `boxes` the boxes before the push. Leaves the box's last cell, the player's and the pushes in all
+// in `to`, `player` and `pushes`, and returns the macro: 0 for the one push, n for n pushes along
+// a tunnel, or -1 - p for pushes along to a room's entrance and then path p.
+int carry_macro(Macro_Level *macros, int *offsets, int *boxes, int box_count, int from, int direction,
+                int *to, int *player, int *pushes)
+{
+    int offset = offsets[direction];
+    int at = from + offset;
+    int count = 1;
+
+    for (;;)
+    {
+        int room = macros->entrance_of[at];
+        if (room != -1 && macros->rooms[room].direction == direction) {
+            int filled = room_fill(macros, room, boxes, box_count);
+
+            if (filled != -1) {
+                int path = macros->rooms[room].paths[filled];
+                int length = macros->path_start[path + 1] - macros->path_start[path];
+
+                *to = macros->rooms[room].goals[filled];
+                *player = macros->path_from[macros->path_start[path + 1] - 1];
+                *pushes = count + length;
+                return -1 - path;
+            }
+        }
+
+        if (!(macros->tunnel[at] & (1 << direction)) || cell_has_box(boxes, box_count, at + offset)) break;
+
+        at += offset;
+        count += 1;
+    }
+
+    *to = at;
+    *player = at - offset;
+    *pushes = count;
+    return count > 1 ? count : 0;
+}
+
+// The single pushes a macro stands for, as box cells and directions, into `from` and `directions`
+// when they are not NULL. Returns how many there are.
+int expand_macro(Macro_Level *macros, int *offsets, int macro, int box_from, int direction, int *from, int *directions)
+{
+    int count = 0;
+    int end = macro < 0 ? macros->path_from[macros->path_start[-1 - macro]] : box_from + offsets[direction] * (macro > 0 ? macro : 1);
+
+    for (int cell = box_from; cell != end; cell += offsets[direction])
+    {
+        if (from) from[count] = cell;
+        if (directions) directions[count] = direction;
+        count += 1;
+    }
+
+    if (macro < 0) {
+        int path = -1 - macro;
+        for (int p = macros->path_start[path]; p < macros->path_start[path + 1]; p += 1)
+        {
+            if (from) from[count] = macros->path_from[p];
+            if (directions) directions[count] = macros->path_direction[p];
+            count += 1;
+        }
+    }
+
+    return count;
+}
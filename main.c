@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 
 #include "SDL.h"
 #include "SDL_ttf.h"
 #include "SDL_image.h"
 
+#include "board.c"
+#include "stuck.c"
+
 typedef enum {
     PLAY,
     QUIT
@@ -31,21 +35,6 @@ typedef enum {
     TITLE
 } Mode;
 
-typedef enum {
-    FLOOR,
-    WALL,
-    GOAL,
-} Tile_Type;
-
-typedef struct {
-    Tile_Type type;
-
-    int x, y;
-
-    bool has_player;
-    bool has_box;
-} Tile;
-
 typedef enum {
     NORTH,
     EAST,
@@ -65,10 +54,8 @@ typedef struct {
     bool is_handled;
 } Event;
 
-typedef struct {
-    Tile tiles[100][100];
-    int w, h;
-} Board;
+// Events one frame can take, more are dropped.
+#define MAX_EVENTS 100
 
 typedef struct {
     bool quit;
@@ -103,10 +90,11 @@ typedef struct {
 
     Board board;
 
-    Event events[100];
+    Event events[MAX_EVENTS];
     int event_count;
 
     int level;
+    int moves_applied;
 
 } Game_State;
 
@@ -156,6 +144,14 @@ Event make_event(Event_Type type, Direction direction)
     };
 }
 
+void push_event(Game_State *game_state, Event event)
+{
+    if (game_state->event_count == MAX_EVENTS) return;
+
+    game_state->events[game_state->event_count] = event;
+    game_state->event_count += 1;
+}
+
 void get_input(Game_State *game_state)
 {
     SDL_GetMouseState(&game_state->ui.mouse_position.x, &game_state->ui.mouse_position.y);
@@ -178,23 +174,19 @@ void get_input(Game_State *game_state)
                         break;
 
                     case SDLK_w:
-                        game_state->events[game_state->event_count] = make_event(MOVE, NORTH);
-                        game_state->event_count += 1;
+                        push_event(game_state, make_event(MOVE, NORTH));
                         break;
 
                     case SDLK_a:
-                        game_state->events[game_state->event_count] = make_event(MOVE, WEST);
-                        game_state->event_count += 1;
+                        push_event(game_state, make_event(MOVE, WEST));
                         break;
 
                     case SDLK_s:
-                        game_state->events[game_state->event_count] = make_event(MOVE, SOUTH);
-                        game_state->event_count += 1;
+                        push_event(game_state, make_event(MOVE, SOUTH));
                         break;
 
                     case SDLK_d:
-                        game_state->events[game_state->event_count] = make_event(MOVE, EAST);
-                        game_state->event_count += 1;
+                        push_event(game_state, make_event(MOVE, EAST));
                         break;
 
                     default:
@@ -229,53 +221,42 @@ void apply_event(Event event, Board *board)
     switch (event.type)
     {
         case MOVE: {
-            int x_increment = 0;
-            int y_increment = 0;
+            int i_increment = 0;
+            int j_increment = 0;
 
             switch (event.direction)
             {
-                case NORTH: x_increment = -1;    y_increment = 0;   break;
-                case WEST:  x_increment = 0;     y_increment = -1;    break;
-                case SOUTH: x_increment = 1;     y_increment = 0;    break;
-                case EAST:  x_increment = 0;     y_increment = 1;    break;
+                case NORTH: i_increment = -1;    j_increment = 0;   break;
+                case WEST:  i_increment = 0;     j_increment = -1;    break;
+                case SOUTH: i_increment = 1;     j_increment = 0;    break;
+                case EAST:  i_increment = 0;     j_increment = 1;    break;
                 default: break;
             }
 
-            Tile *player_tile;
-            for (int i = 0; i < board->h; i += 1)
-            {
-                for (int j = 0; j < board->w; j += 1)
-                {
-                    if (board->tiles[i][j].has_player) player_tile = &board->tiles[i][j];
-                }
-            }
+            Board_Cursor cursor = make_cursor(board);
 
-            int target_x = player_tile->x + x_increment;
-            int target_y = player_tile->y + y_increment;
-            Tile *target_tile = &board->tiles[target_x][target_y];
+            int target_i = board->player_i + i_increment;
+            int target_j = board->player_j + j_increment;
+            Tile target_tile = read_tile(&cursor, target_i, target_j);
 
-            if (target_tile->type == WALL) {
+            if (tile_type(target_tile) == WALL) {
                 return;
-            } else if (target_tile->type == FLOOR || target_tile->type == GOAL) {
-                if (target_tile->has_box) {
-                    int next_target_x = target_tile->x + x_increment;
-                    int next_target_y = target_tile->y + y_increment;
-                    Tile *next_target_tile = &board->tiles[next_target_x][next_target_y];
+            } else if (tile_has_box(target_tile)) {
+                int next_target_i = target_i + i_increment;
+                int next_target_j = target_j + j_increment;
+                Tile next_target_tile = read_tile(&cursor, next_target_i, next_target_j);
 
-                    if (next_target_tile->type == WALL) {
-                        return;
-                    } else if (next_target_tile->type == FLOOR || next_target_tile->type == GOAL) {
-                        target_tile->has_box = false;
-                        next_target_tile->has_box = true;
+                if (tile_type(next_target_tile) == WALL || tile_has_box(next_target_tile)) {
+                    return;
+                }
 
-                        target_tile->has_player = true;
+                set_box(&cursor, target_i, target_j, false);
+                set_box(&cursor, next_target_i, next_target_j, true);
+                set_player(&cursor, target_i, target_j);
 
-                        player_tile->has_player = false;
-                    }
-                } else {
-                    player_tile->has_player = false;
-                    target_tile->has_player = true;
-                }
+                check_stuck_box(&cursor, next_target_i, next_target_j);
+            } else {
+                set_player(&cursor, target_i, target_j);
             }
 
         } break;
@@ -289,15 +270,19 @@ bool handle_events(Game_State *game_state)
 {
     bool did_something = false;
 
-    int i = game_state->event_count-1;
-    while (!game_state->events[i].is_handled)
+    for (int i = 0; i < game_state->event_count; i += 1)
     {
+        if (game_state->events[i].is_handled) continue;
+
         apply_event(game_state->events[i], &game_state->board);
         game_state->events[i].is_handled = true;
+        game_state->moves_applied += 1;
 
         did_something = true;
     }
 
+    game_state->event_count = 0;
+
     return did_something;
 }
 
@@ -319,115 +304,95 @@ void handle_button(Game_State *game_state, Button *button)
     }
 }
 
-bool populate_board_with_level(Board *board, int level_number)
+bool populate_board_from_file(Board *board, char *filename)
 {
-    char level[50];
-    sprintf(level, "../assets/levels/%d.txt", level_number);
-
-    FILE *file = fopen(level, "r");
+    FILE *file = fopen(filename, "rb");
 
     if (!file) return false;
 
-    char *data;
-    int size;
-
-    if (file) 
-    {
-        fseek(file, 0, SEEK_END);
-        size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-
-        data = malloc(size+1);
-        fread(data, 1, size, file);
-        data[size] = 0;
-
-        fclose(file);
-    }
+    Level_Reader *reader = malloc(sizeof(Level_Reader));
+    reader->file = file;
+    reader->at = 0;
+    reader->size = 0;
 
+    // First pass just measures, the first row sets the width.
     int columns = 0;
-    while (data[columns] != '\n') {
-        columns += 1;
-    }
+    int rows = 0;
+    int length;
 
-    int rows = 1;
+    while (next_row(reader, NULL, 0, &length))
     {
-        int i = 0;
-        while (i < size) {
-            if (data[i] == '\n') rows += 1;
+        if (rows == 0) columns = length;
+        rows += 1;
+    }
 
-            i += 1;
-        }
+    if (rows == 0 || columns == 0) {
+        free(reader);
+        fclose(file);
+        return false;
     }
 
-    board->w = columns;
-    board->h = rows;
+    fseek(file, 0, SEEK_SET);
+    reader->at = 0;
+    reader->size = 0;
 
-    int raw_index = 0;
+    init_board(board, columns, rows);
 
-    int i = 0;
-    while (i < rows)
+    // Second pass fills one band of chunk rows at a time, so a level never has to fit in memory whole.
+    Tile *band = malloc((size_t)CHUNK_SIZE * columns);
+
+    for (int i = 0; i < rows; i += 1)
     {
-        int j = 0;
-        while (j < columns)
-        {
-            Tile *tile = &board->tiles[i][j];
+        Tile *row = &band[(size_t)(i & CHUNK_MASK) * columns];
+        next_row(reader, row, columns, NULL);
 
-            if (data[raw_index] == '\n') {
-                raw_index += 1;
-                continue;
+        for (int j = 0; j < columns; j += 1)
+        {
+            if (tile_has_player(row[j])) {
+                board->player_i = i;
+                board->player_j = j;
             }
 
-            tile->has_player = false;
-            tile->has_box = false;
-            tile->x = i;
-            tile->y = j;
+            if (tile_type(row[j]) == GOAL && !tile_has_box(row[j])) board->goals_left += 1;
+            if (tile_type(row[j]) == GOAL) board->spare_boxes -= 1;
+            if (tile_has_box(row[j])) board->spare_boxes += 1;
+            if (tile_has_box(row[j])) board->hash ^= zobrist_key(i, j, ZOBRIST_BOX);
+        }
 
-            switch (data[raw_index]) {
-                case '.':
-                    tile->type = FLOOR;
-                break;
-                case 'w':
-                    tile->type = WALL;
-                break;
-                case 'g':
-                    tile->type = GOAL;
-                break;
-                case '@':
-                    tile->type = FLOOR;
-                    tile->has_player = true;
-                break;
-                case 'o':
-                    tile->type = FLOOR;
-                    tile->has_box = true;
-                break;
-                default:
-                    tile->type = WALL;
-                break;
+        bool band_full = (i & CHUNK_MASK) == CHUNK_MASK;
+        bool last_row = i == rows - 1;
+
+        if (band_full || last_row) {
+            if (!band_full) {
+                int filled = (i & CHUNK_MASK) + 1;
+                memset(&band[(size_t)filled * columns], WALL, (size_t)(CHUNK_SIZE - filled) * columns);
             }
 
-            raw_index += 1;
-            j += 1;
+            store_band(board, band, i >> CHUNK_SHIFT);
         }
-
-        i += 1;
     }
 
+    board->hash ^= zobrist_key(board->player_i, board->player_j, ZOBRIST_PLAYER);
+
+    free(band);
+    free(reader);
+    fclose(file);
+
     return true;
 }
 
-bool check_win_conditions(Board board)
+bool populate_board_with_level(Board *board, int level_number)
 {
-    for (int i = 0; i < board.h; i += 1)
-    {
-        for (int j = 0; j < board.w; j += 1)
-        {
-            if (board.tiles[i][j].type == GOAL && !board.tiles[i][j].has_box) {
-                return false;
-            }
-        }
-    }
+    char level[50];
+    sprintf(level, "../assets/levels/%d.txt", level_number);
 
-    return true;
+    return populate_board_from_file(board, level);
+}
+
+bool check_win_conditions(Board board)
+{
+    // apply_event keeps the count, so this does not have to page the whole board in.
+    return board.goals_left == 0;
 }
 
 void update(Game_State *game_state, float delta_t)
@@ -475,6 +440,7 @@ void update(Game_State *game_state, float delta_t)
         case GAME: {
             if (game_state->reset) {
                 game_state->ui.button_count = 0;
+                game_state->event_count = 0;
 
                 bool next_level_exists = populate_board_with_level(&game_state->board, game_state->level);
 
@@ -505,6 +471,7 @@ void update(Game_State *game_state, float delta_t)
             if (game_state->reset) {
                 game_state->ui.button_count = 0;
                 game_state->loading.total_time = 0.2;
+                game_state->loading.time_elapsed = 0;
                 game_state->reset = false;
             }
 
@@ -630,6 +597,8 @@ void draw_sprite(SDL_Renderer *renderer, SDL_Rect source, SDL_Rect destination)
 
 void render_game(SDL_Renderer *renderer, Game_State game_state)
 {
+    Board *board = &game_state.board;
+
     SDL_Rect viewport = {
         game_state.window.x * 0.1f,
         game_state.window.y * 0.1f,
@@ -637,6 +606,23 @@ void render_game(SDL_Renderer *renderer, Game_State game_state)
         0,
     };
 
+    // Boards bigger than the window scroll to keep the player in the middle.
+    if (viewport.x + board->w * sheet.width > game_state.window.x) {
+        viewport.x = game_state.window.x/2 - board->player_j * sheet.width - sheet.width/2;
+    }
+
+    if (viewport.y + board->h * sheet.height > game_state.window.y) {
+        viewport.y = game_state.window.y/2 - board->player_i * sheet.height - sheet.height/2;
+    }
+
+    // Only the tiles that land in the window.
+    int first_i = viewport.y < 0 ? -viewport.y / sheet.height : 0;
+    int first_j = viewport.x < 0 ? -viewport.x / sheet.width : 0;
+    int last_i = (game_state.window.y - viewport.y) / sheet.height + 1;
+    int last_j = (game_state.window.x - viewport.x) / sheet.width + 1;
+    if (last_i > board->h) last_i = board->h;
+    if (last_j > board->w) last_j = board->w;
+
     SDL_Rect source;
     source.w = sheet.width;
     source.h = sheet.height;
@@ -647,18 +633,20 @@ void render_game(SDL_Renderer *renderer, Game_State game_state)
 
 
     SDL_Rect destination = {
-        viewport.x,
-        viewport.y,
+        viewport.x + first_j * sheet.width,
+        viewport.y + first_i * sheet.height,
         sheet.width, sheet.height 
     };
 
-    for (int i = 0; i < game_state.board.h; i += 1)
+    Board_Cursor cursor = make_cursor(board);
+
+    for (int i = first_i; i < last_i; i += 1)
     {
-        for (int j = 0; j < game_state.board.w; j += 1)
+        for (int j = first_j; j < last_j; j += 1)
         {
-            Tile tile = game_state.board.tiles[i][j];
+            Tile tile = read_tile(&cursor, i, j);
 
-            switch (tile.type) {
+            switch (tile_type(tile)) {
                 case FLOOR:
                     source.x = 11 * source.w;
                     source.y = 6 * source.h;
@@ -675,13 +663,20 @@ void render_game(SDL_Renderer *renderer, Game_State game_state)
 
             draw_sprite(renderer, source, destination);
 
-            if (tile.has_box) {
+            if (tile_has_box(tile)) {
                 second_layer_source.x = 6 * second_layer_source.w;
                 second_layer_source.y = 0 * second_layer_source.h;
-                draw_sprite(renderer, second_layer_source, destination);
+
+                if (tile_is_stuck(tile)) {
+                    SDL_SetTextureColorMod(texture, 255, 80, 80);
+                    draw_sprite(renderer, second_layer_source, destination);
+                    SDL_SetTextureColorMod(texture, 255, 255, 255);
+                } else {
+                    draw_sprite(renderer, second_layer_source, destination);
+                }
             }
 
-            if (tile.has_player) {
+            if (tile_has_player(tile)) {
                 second_layer_source.x = 0 * second_layer_source.w;
                 second_layer_source.y = 4 * second_layer_source.h;
                 draw_sprite(renderer, second_layer_source, destination);
@@ -691,7 +686,12 @@ void render_game(SDL_Renderer *renderer, Game_State game_state)
         }
 
         destination.y += destination.h;
-        destination.x = viewport.x;
+        destination.x = viewport.x + first_j * sheet.width;
+    }
+
+    if (board->stuck_boxes > 0) {
+        SDL_Rect message_rect = {0, 0, game_state.window.x, game_state.window.y * 0.1f};
+        draw_centered_text(renderer, message_rect, "Stuck! Press R to restart", game_state.ui.font, game_state.ui.font_color);
     }
 }
 
@@ -755,8 +755,235 @@ void render(SDL_Renderer *renderer, Game_State game_state)
     SDL_RenderPresent(renderer);
 }
 
+#ifndef SOKOBAN_NO_MAIN
+typedef struct {
+    bool active;
+
+    // One line of w/a/s/d per level, in level order.
+    char **solutions;
+    int solution_count;
+
+    int level;
+    int cursor;
+    int moves_per_frame;
+    bool started;
+    bool failed;
+    Uint64 game_start;
+
+    Uint64 *frame_times;
+    int frame_count;
+    int frame_capacity;
+} Replay;
+
+bool load_replay(Replay *replay, char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    int size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = malloc(size+1);
+    fread(data, 1, size, file);
+    data[size] = 0;
+    fclose(file);
+
+    replay->solutions = malloc(sizeof(char *) * (size+1));
+    replay->solution_count = 0;
+
+    char *line = data;
+    for (int i = 0; i <= size; i += 1)
+    {
+        if (data[i] == '\n' || data[i] == '\r' || data[i] == 0) {
+            bool is_end = data[i] == 0;
+            data[i] = 0;
+
+            if (line[0] != 0) {
+                replay->solutions[replay->solution_count] = line;
+                replay->solution_count += 1;
+            }
+
+            line = &data[i+1];
+            if (is_end) break;
+        }
+    }
+
+    return replay->solution_count > 0;
+}
+
+SDL_Keycode key_for_move(char move)
+{
+    switch (move)
+    {
+        case 'w': case 'W': return SDLK_w;
+        case 'a': case 'A': return SDLK_a;
+        case 's': case 'S': return SDLK_s;
+        case 'd': case 'D': return SDLK_d;
+        default: return SDLK_UNKNOWN;
+    }
+}
+
+// Feed the next recorded moves into SDL's queue, so they go through get_input like real key presses.
+void replay_push_input(Replay *replay, Game_State *game_state)
+{
+    if (game_state->mode == TITLE && replay->started) {
+        game_state->quit = true;
+        return;
+    }
+
+    if (game_state->mode != GAME || game_state->reset) return;
+
+    if (!replay->started) {
+        replay->started = true;
+        replay->game_start = SDL_GetPerformanceCounter();
+    }
+
+    if (game_state->level != replay->level) {
+        replay->level = game_state->level;
+        replay->cursor = 0;
+    }
+
+    if (replay->level > replay->solution_count) {
+        replay->failed = true;
+        game_state->quit = true;
+        return;
+    }
+
+    char *solution = replay->solutions[replay->level - 1];
+
+    if (solution[replay->cursor] == 0) {
+        // The recorded moves ran out and the level was not won.
+        replay->failed = true;
+        game_state->quit = true;
+        return;
+    }
+
+    for (int i = 0; i < replay->moves_per_frame && solution[replay->cursor] != 0; i += 1)
+    {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = SDL_KEYDOWN;
+        event.key.state = SDL_PRESSED;
+        event.key.keysym.sym = key_for_move(solution[replay->cursor]);
+        SDL_PushEvent(&event);
+
+        replay->cursor += 1;
+    }
+}
+
+void record_frame_time(Replay *replay, Uint64 ticks)
+{
+    if (replay->frame_count == replay->frame_capacity) {
+        replay->frame_capacity = replay->frame_capacity ? replay->frame_capacity * 2 : 1024;
+        replay->frame_times = realloc(replay->frame_times, sizeof(Uint64) * replay->frame_capacity);
+    }
+
+    replay->frame_times[replay->frame_count] = ticks;
+    replay->frame_count += 1;
+}
+
+int compare_frame_times(const void *a, const void *b)
+{
+    Uint64 x = *(Uint64 *)a;
+    Uint64 y = *(Uint64 *)b;
+    return (x > y) - (x < y);
+}
+
+void report_replay(Replay *replay, Game_State *game_state, Uint64 total_ticks, char *out)
+{
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double total_seconds = total_ticks / frequency;
+
+    // Moves per second only counts time spent in levels, not the loading screen.
+    double game_seconds = replay->started ? (SDL_GetPerformanceCounter() - replay->game_start) / frequency : 0;
+    double moves_per_second = game_seconds > 0 ? game_state->moves_applied / game_seconds : 0;
+
+    printf("Replay %s\n", replay->failed ? "FAILED: recorded moves did not win every level" : "finished");
+    printf("  levels played   %d\n", replay->level);
+    printf("  total frames    %d\n", replay->frame_count);
+    printf("  total time      %.3f ms\n", total_seconds * 1000.0);
+    printf("  moves applied   %d\n", game_state->moves_applied);
+    printf("  moves/second    %.1f\n", moves_per_second);
+    printf("  frames/second   %.1f\n", total_seconds > 0 ? replay->frame_count / total_seconds : 0);
+
+    if (replay->frame_count == 0) return;
+
+    Uint64 *sorted = malloc(sizeof(Uint64) * replay->frame_count);
+    memcpy(sorted, replay->frame_times, sizeof(Uint64) * replay->frame_count);
+    qsort(sorted, replay->frame_count, sizeof(Uint64), compare_frame_times);
+
+    double percentiles[] = {0, 50, 90, 99, 100};
+    printf("  frame time (us) ");
+    for (size_t i = 0; i < sizeof(percentiles)/sizeof(percentiles[0]); i += 1)
+    {
+        int index = (int)(percentiles[i] / 100.0 * (replay->frame_count - 1));
+        printf(" p%.0f=%.1f", percentiles[i], sorted[index] * 1e6 / frequency);
+    }
+    printf("\n");
+
+    free(sorted);
+
+    if (!out) return;
+
+    FILE *file = fopen(out, "w");
+    if (!file) {
+        printf("Could not write %s\n", out);
+        return;
+    }
+
+    // Same layout as bench.json, so replay runs can be compared like any other benchmark.
+    fprintf(file, "{\n");
+    fprintf(file, "  \"unit\": \"ns/op\",\n");
+    fprintf(file, "  \"benchmarks\": [\n");
+    fprintf(file, "    {\"name\": \"replay/frame\", \"board\": \"all_levels\", \"iterations\": 1, \"moves_applied\": %d, \"moves_per_second\": %.3f, \"samples\": [",
+            game_state->moves_applied,
+            moves_per_second);
+    for (int i = 0; i < replay->frame_count; i += 1)
+    {
+        fprintf(file, i ? ", %.1f" : "%.1f", replay->frame_times[i] * 1e9 / frequency);
+    }
+    fprintf(file, "]}\n");
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+}
+
 int main(int argc, char *argv[])
 {
+    Replay replay;
+    SDL_zero(replay);
+    replay.moves_per_frame = 1;
+    char *replay_out = NULL;
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            if (!load_replay(&replay, argv[++i])) {
+                printf("Could not load replay %s\n", argv[i]);
+                return 1;
+            }
+            replay.active = true;
+        } else if (!strcmp(argv[i], "--moves-per-frame") && i + 1 < argc) {
+            replay.moves_per_frame = atoi(argv[++i]);
+            if (replay.moves_per_frame < 1) replay.moves_per_frame = 1;
+
+            // Moves past what a frame can take would be dropped and the replay would stop matching the solutions.
+            if (replay.moves_per_frame > MAX_EVENTS) {
+                printf("--moves-per-frame %d is more than a frame takes, using %d\n", replay.moves_per_frame, MAX_EVENTS);
+                replay.moves_per_frame = MAX_EVENTS;
+            }
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            replay_out = argv[++i];
+        }
+    }
+
+    if (replay.active) {
+        // Headless, so it runs the same on machines without a display.
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     SDL_Init(SDL_INIT_EVERYTHING);
     IMG_Init(IMG_INIT_PNG);
 
@@ -780,7 +1007,9 @@ int main(int argc, char *argv[])
 			SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
 	// Setup renderer
-	SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	Uint32 renderer_flags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+	if (replay.active) renderer_flags = 0;
+	SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, renderer_flags);
 
 	// Setup font
 	TTF_Init();
@@ -802,17 +1031,29 @@ int main(int argc, char *argv[])
     game_state.ui.font = font;
     game_state.ui.title_font = title_font;
     game_state.ui.font_color = font_color;
-    game_state.event_count = 0; // TODO(bkaylor): Do this between levels...
+    game_state.event_count = 0;
     game_state.level = 1;
+    game_state.board = (Board){0};
+    game_state.moves_applied = 0;
+    game_state.loading.time_elapsed = 0;
+
+    if (replay.active) {
+        // Skip the title screen, there is nobody to press Play.
+        game_state.mode = LOADING;
+    }
 
     load_images(renderer);
 
-    int frame_time_start, frame_time_finish;
+    // Performance counter rather than SDL_GetTicks: without vsync a frame can take well under a millisecond.
+    Uint64 frame_time_start, frame_time_finish;
+    Uint64 replay_start = SDL_GetPerformanceCounter();
     float delta_t = 0;
 
     while (!game_state.quit)
     {
-        frame_time_start = SDL_GetTicks();
+        frame_time_start = SDL_GetPerformanceCounter();
+
+        if (replay.active) replay_push_input(&replay, &game_state);
 
         SDL_PumpEvents();
         get_input(&game_state);
@@ -824,14 +1065,23 @@ int main(int argc, char *argv[])
             update(&game_state, delta_t);
             render(renderer, game_state);
 
-            frame_time_finish = SDL_GetTicks();
-            delta_t = (float)((frame_time_finish - frame_time_start) / 1000.0f);
+            frame_time_finish = SDL_GetPerformanceCounter();
+            delta_t = (float)((double)(frame_time_finish - frame_time_start) / (double)SDL_GetPerformanceFrequency());
+
+            if (replay.active) record_frame_time(&replay, frame_time_finish - frame_time_start);
         }
     }
 
+    if (replay.active) {
+        report_replay(&replay, &game_state, SDL_GetPerformanceCounter() - replay_start, replay_out);
+    }
+
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
+    if (replay.active && replay.failed) return 1;
+
     return 0;
 }
+#endif
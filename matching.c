@@ -0,0 +1,210 @@
+//
+// Lower bound by minimum cost matching of boxes to goals.
+//
+// Every goal needs its own box, so the cheapest way to give each goal a
+// different box, in push distances with the other boxes ignored, is a lower
+// bound on the pushes left. It is never below the sum of nearest goal
+// distances, and it stops counting one box twice for two goals.
+//
+// The matching is the Hungarian algorithm on a square matrix: rows are
+// boxes, columns are goals, plus free columns when there are more boxes than
+// goals. It keeps its dual potentials, so when one box moves only that
+// box's row has to be matched again, one augmenting path instead of a
+// solve from scratch. The search solves the node it expands and moves one
+// box in a copy of that for every child.
+//
+
+#include <limits.h>
+
+// Cost of a box that can not reach a goal. Big enough that any matching using it is over
+// MATCHING_UNREACHABLE, small enough that the potentials never overflow.
+#define MATCHING_UNREACHABLE (1LL << 32)
+
+typedef struct {
+    int size;
+
+    // distances[cell * goal_count + goal], as in Solver_Level.
+    int *distances;
+    int goal_count;
+
+    // Everything below is 1 based, 0 is the Hungarian algorithm's sentinel.
+    int *row_cell;
+    long long *row_potential;
+    long long *column_potential;
+    int *column_row;
+
+    // Scratch for one augmenting path.
+    long long *slack;
+    int *way;
+    bool *used;
+
+    long long cost;
+} Matching;
+
+void init_matching(Matching *matching, int box_count, int *distances, int goal_count)
+{
+    int n = box_count + 1;
+
+    matching->size = box_count;
+    matching->distances = distances;
+    matching->goal_count = goal_count;
+    matching->row_cell = calloc(n, sizeof(int));
+    matching->row_potential = calloc(n, sizeof(long long));
+    matching->column_potential = calloc(n, sizeof(long long));
+    matching->column_row = calloc(n, sizeof(int));
+    matching->slack = calloc(n, sizeof(long long));
+    matching->way = calloc(n, sizeof(int));
+    matching->used = calloc(n, sizeof(bool));
+    matching->cost = 0;
+}
+
+void free_matching(Matching *matching)
+{
+    free(matching->row_cell);
+    free(matching->row_potential);
+    free(matching->column_potential);
+    free(matching->column_row);
+    free(matching->slack);
+    free(matching->way);
+    free(matching->used);
+    memset(matching, 0, sizeof(*matching));
+}
+
+// Copies the state but not the scratch, so the copy can be moved on without touching the original.
+void copy_matching(Matching *to, Matching *from)
+{
+    size_t n = from->size + 1;
+    memcpy(to->row_cell, from->row_cell, sizeof(int) * n);
+    memcpy(to->row_potential, from->row_potential, sizeof(long long) * n);
+    memcpy(to->column_potential, from->column_potential, sizeof(long long) * n);
+    memcpy(to->column_row, from->column_row, sizeof(int) * n);
+    to->cost = from->cost;
+}
+
+long long matching_cost(Matching *matching, int row, int column)
+{
+    // The free columns take a box that no goal needs.
+    if (column > matching->goal_count) return 0;
+
+    int distance = matching->distances[(size_t)matching->row_cell[row] * matching->goal_count + column - 1];
+    return distance >= SOLVER_INFINITY ? MATCHING_UNREACHABLE : distance;
+}
+
+// Finds the cheapest augmenting path from an unmatched row, keeping the potentials feasible
+// and every matched pair tight.
+void augment_matching(Matching *matching, int row)
+{
+    int n = matching->size;
+    long long *u = matching->row_potential;
+    long long *v = matching->column_potential;
+    int *p = matching->column_row;
+
+    for (int j = 0; j <= n; j += 1)
+    {
+        matching->slack[j] = LLONG_MAX;
+        matching->used[j] = false;
+    }
+
+    p[0] = row;
+    int j0 = 0;
+
+    do
+    {
+        matching->used[j0] = true;
+        int i0 = p[j0];
+        long long delta = LLONG_MAX;
+        int j1 = 0;
+
+        for (int j = 1; j <= n; j += 1)
+        {
+            if (matching->used[j]) continue;
+
+            long long reduced = matching_cost(matching, i0, j) - u[i0] - v[j];
+            if (reduced < matching->slack[j]) {
+                matching->slack[j] = reduced;
+                matching->way[j] = j0;
+            }
+
+            if (matching->slack[j] < delta) {
+                delta = matching->slack[j];
+                j1 = j;
+            }
+        }
+
+        for (int j = 0; j <= n; j += 1)
+        {
+            if (matching->used[j]) {
+                u[p[j]] += delta;
+                v[j] -= delta;
+            } else {
+                matching->slack[j] -= delta;
+            }
+        }
+
+        j0 = j1;
+    } while (p[j0] != 0);
+
+    do
+    {
+        int j1 = matching->way[j0];
+        p[j0] = p[j1];
+        j0 = j1;
+    } while (j0 != 0);
+}
+
+int matching_bound(Matching *matching)
+{
+    long long cost = 0;
+    for (int j = 1; j <= matching->size; j += 1) cost += matching_cost(matching, matching->column_row[j], j);
+
+    matching->cost = cost;
+    return cost >= MATCHING_UNREACHABLE ? SOLVER_INFINITY : (int)cost;
+}
+
+// From scratch, O(boxes^3).
+int solve_matching(Matching *matching, int *boxes)
+{
+    int n = matching->size;
+
+    for (int i = 0; i <= n; i += 1)
+    {
+        matching->row_potential[i] = 0;
+        matching->column_potential[i] = 0;
+        matching->column_row[i] = 0;
+    }
+
+    for (int i = 1; i <= n; i += 1)
+    {
+        matching->row_cell[i] = boxes[i - 1];
+        augment_matching(matching, i);
+    }
+
+    return matching_bound(matching);
+}
+
+// Box `box` (0 based, in the order solve_matching was given) is now on `cell`. O(boxes^2).
+int move_matching_box(Matching *matching, int box, int cell)
+{
+    int n = matching->size;
+    int row = box + 1;
+
+    matching->row_cell[row] = cell;
+
+    for (int j = 1; j <= n; j += 1)
+    {
+        if (matching->column_row[j] == row) matching->column_row[j] = 0;
+    }
+
+    // The row's costs changed, so its potential goes to the most it can be with every pair still feasible.
+    long long lowest = LLONG_MAX;
+    for (int j = 1; j <= n; j += 1)
+    {
+        long long reduced = matching_cost(matching, row, j) - matching->column_potential[j];
+        if (reduced < lowest) lowest = reduced;
+    }
+    matching->row_potential[row] = lowest;
+
+    augment_matching(matching, row);
+
+    return matching_bound(matching);
+}
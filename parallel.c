@@ -0,0 +1,611 @@
+//
+// Parallel search for one level, in the HDA* style.
+//
+// Every position has an owner, a worker picked from its hash. A worker pops
+// its own best node, expands it and sends each child to the child's owner,
+// which is the only worker that ever adds, updates or expands it, so node
+// stores and heaps stay private. Messages are batched per destination and
+// handed over under a mutex. All workers share one transposition table,
+// which lets a sender drop a child its owner already has cheaper without
+// sending it.
+//
+// A shared count of outstanding work (queued messages plus heap entries)
+// tells the workers when to stop. Every child is counted before its parent
+// is taken off, so the count only reaches zero when the search is over.
+//
+// Workers keep going after a solution turns up until nothing left anywhere
+// has a smaller f, so the push count is optimal and the same on every run.
+// Which of several equally short solutions the workers find depends on
+// timing, down to the parent each position kept, so the moves are found
+// again by one IDA* iteration under that push count, see
+// replay_parallel_solution. It tries the children in a fixed order, so the
+// moves are the same on every run and for any number of workers. The
+// counters are added up in worker order.
+//
+// A solved position lowers the shared best push count as soon as it is
+// generated, and every worker drops what can not beat it. Workers also keep
+// to the order one worker would take: a worker only expands while its best
+// node comes no later in heap order, smaller f and then deeper first, than
+// anything another worker has waiting or has been sent. Without that, a
+// worker with a core to itself ran on through its own heap to nodes the
+// others would have cut, and two to eight workers expanded 20 to 220 times
+// the nodes of one on level 3.
+//
+// It is experimental and not known to be faster. It has only been run on
+// one core, where the workers take turns. There two to eight of them expand
+// about as many nodes as one, 52 to 67 against 109 on level 3 and 500 to
+// 750 against 2936 on x1, in about as much time. On real cores the waiting
+// may keep it far from linear, and that has not been measured.
+//
+
+#define PARALLEL_MAX_WORKERS 64
+#define PARALLEL_FLUSH_BYTES (16 * 1024)
+#define PARALLEL_NO_FRONT 0x7fffffff
+
+typedef struct {
+    unsigned long long box_hash;
+
+    int parent;
+    int parent_worker;
+    int player;
+    int g;
+    int f;
+    int box_from;
+    int direction;
+    int macro;
+    int symmetry;
+
+    int boxes[];
+} Parallel_Message;
+
+typedef struct {
+    char *data;
+    size_t used;
+    size_t capacity;
+} Parallel_Buffer;
+
+typedef struct Parallel_Search Parallel_Search;
+
+typedef struct {
+    Parallel_Search *search;
+    int index;
+
+    Solver solver;
+    int *boxes;
+    Parallel_Message *local_message;
+
+    // Filled by other workers under the lock, then swapped with `spare` to be read without it.
+    SDL_mutex *inbox_lock;
+    Parallel_Buffer inbox;
+    Parallel_Buffer spare;
+    Parallel_Buffer *outboxes;
+
+    // Work this worker finished but has not taken off the shared count yet.
+    int finished;
+
+    // Where the first node on its heap or in its inbox comes in heap order, as front_key makes it,
+    // PARALLEL_NO_FRONT when both are empty. Senders lower it as they hand messages over.
+    SDL_atomic_t front;
+    // The same for the outboxes since they were last all flushed.
+    int outbox_front;
+
+    long long expanded;
+    long long generated;
+
+    // The best solution this worker has found, as the node it would be. goal.g is SOLVER_INFINITY until then.
+    Solver_Node goal;
+    unsigned long long goal_key;
+} Parallel_Worker;
+
+struct Parallel_Search {
+    Solver_Level *level;
+    Solver_Options *options;
+    Transposition_Table table;
+
+    Parallel_Worker *workers;
+    int worker_count;
+    size_t message_size;
+
+    SDL_atomic_t outstanding;
+    SDL_atomic_t best_g;
+    SDL_atomic_t stop;
+    SDL_atomic_t gave_up;
+
+    // In units of 1024 expansions, so it fits an int.
+    SDL_atomic_t expanded_blocks;
+    double start;
+};
+
+int owner_of(Parallel_Search *search, unsigned long long hash)
+{
+    // Bits the transposition table uses for neither the bucket nor the check.
+    return (int)(((hash >> 32) & 0xffff) % search->worker_count);
+}
+
+void *reserve_bytes(Parallel_Buffer *buffer, size_t bytes)
+{
+    if (buffer->used + bytes > buffer->capacity) {
+        buffer->capacity = (buffer->used + bytes) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+
+    void *at = buffer->data + buffer->used;
+    buffer->used += bytes;
+    return at;
+}
+
+// Smaller f first, then larger g, like heap_less, in one int. Past 32766 pushes f all counts the same.
+int front_key(int f, int g)
+{
+    if (f >= SOLVER_INFINITY) return PARALLEL_NO_FRONT;
+    if (f > 0x7ffe) f = 0x7ffe;
+    if (g > 0xffff) g = 0xffff;
+    return (f << 16) | (0xffff - g);
+}
+
+void lower_atomic(SDL_atomic_t *value, int to)
+{
+    for (;;)
+    {
+        int at = SDL_AtomicGet(value);
+        if (to >= at || SDL_AtomicCAS(value, at, to)) return;
+    }
+}
+
+// Keeps the shorter solution, or of two as short the one with the smaller key, and cuts every
+// worker against it.
+void found_parallel_goal(Parallel_Worker *worker, Solver_Node *goal, unsigned long long key)
+{
+    if (goal->g < worker->goal.g || (goal->g == worker->goal.g && key < worker->goal_key)) {
+        worker->goal = *goal;
+        worker->goal_key = key;
+    }
+
+    lower_atomic(&worker->search->best_g, goal->g);
+}
+
+// The owner's side of a message: add the position, improve it, or drop it.
+void absorb_message(Parallel_Worker *worker, Parallel_Message *message)
+{
+    Solver *solver = &worker->solver;
+
+    if (message->f >= SDL_AtomicGet(&worker->search->best_g)) {
+        worker->finished += 1;
+        return;
+    }
+
+    int known_g;
+    int node = find_position(solver, message->box_hash, message->boxes, message->player, &known_g);
+
+    if (node != -1 && solver->nodes[node].g <= message->g) {
+        worker->finished += 1;
+        return;
+    }
+
+    if (node == -1) node = add_node(solver, message->box_hash, message->boxes, message->player);
+
+    Solver_Node *target = &solver->nodes[node];
+    target->parent = message->parent;
+    target->parent_worker = message->parent_worker;
+    target->box_from = message->box_from;
+    target->direction = message->direction;
+    target->macro = message->macro;
+    target->symmetry = message->symmetry;
+    target->g = message->g;
+    target->f = message->f;
+
+    transposition_insert(solver->table, message->box_hash ^ solver->level->player_keys[message->player], message->g, node, &solver->table_stats);
+    heap_push(solver, node);
+    worker->generated += 1;
+}
+
+void flush_outbox(Parallel_Worker *worker, int destination)
+{
+    Parallel_Buffer *outbox = &worker->outboxes[destination];
+    if (outbox->used == 0) return;
+
+    Parallel_Worker *owner = &worker->search->workers[destination];
+
+    SDL_LockMutex(owner->inbox_lock);
+    memcpy(reserve_bytes(&owner->inbox, outbox->used), outbox->data, outbox->used);
+    lower_atomic(&owner->front, worker->outbox_front);
+    SDL_UnlockMutex(owner->inbox_lock);
+
+    outbox->used = 0;
+}
+
+void flush_outboxes(Parallel_Worker *worker)
+{
+    for (int w = 0; w < worker->search->worker_count; w += 1) flush_outbox(worker, w);
+    worker->outbox_front = PARALLEL_NO_FRONT;
+}
+
+void receive_messages(Parallel_Worker *worker)
+{
+    SDL_LockMutex(worker->inbox_lock);
+    Parallel_Buffer swap = worker->inbox;
+    worker->inbox = worker->spare;
+    worker->spare = swap;
+    SDL_UnlockMutex(worker->inbox_lock);
+
+    for (size_t at = 0; at < worker->spare.used; at += worker->search->message_size)
+    {
+        absorb_message(worker, (Parallel_Message *)(worker->spare.data + at));
+    }
+
+    worker->spare.used = 0;
+}
+
+void expand_parallel(Parallel_Worker *worker, int node)
+{
+    Parallel_Search *search = worker->search;
+    Solver_Level *level = search->level;
+    Solver *solver = &worker->solver;
+
+    int *boxes = worker->boxes;
+    boxes_of(solver, node, boxes);
+
+    int g = solver->nodes[node].g;
+    int best = SDL_AtomicGet(&search->best_g);
+    int sent = 0;
+
+    int push_count = generate_pushes(solver, boxes, solver->nodes[node].player);
+    lower_bound(solver, boxes);
+
+    for (int p = 0; p < push_count; p += 1)
+    {
+        int b = solver->push_box[p];
+        int d = solver->push_direction[p];
+        int from = boxes[b];
+
+        int to, player, pushes;
+        int macro = carry_push(solver, boxes, b, d, &to, &player, &pushes);
+
+        int *child_boxes = solver->child_boxes;
+        memcpy(child_boxes, boxes, sizeof(int) * level->box_count);
+        child_boxes[b] = to;
+        resort_box(child_boxes, level->box_count, b);
+
+        if (push_deadlocked_child(solver, child_boxes, to)) continue;
+
+        int h = child_lower_bound(solver, boxes, b, to);
+        if (h == SOLVER_INFINITY || g + pushes + h >= best) continue;
+
+        unsigned long long box_hash = solver->nodes[node].box_hash ^ level->box_keys[from] ^ level->box_keys[to];
+        player = flood_player_after_push(solver, solver->parent_reach, child_boxes, from, to, player, macro);
+        int symmetry = canonical_symmetry(solver, child_boxes, &box_hash, &player);
+        turn_boxes(level, symmetry, child_boxes);
+        unsigned long long hash = box_hash ^ level->player_keys[player];
+        int owner = owner_of(search, hash);
+
+        // Solved positions are not sent, so the bound drops as soon as one is generated rather than
+        // once its owner gets to it, which can be long after on a busy worker.
+        if (h == 0 && is_solved_position(level, child_boxes)) {
+            Solver_Node goal;
+            goal.box_hash = box_hash;
+            goal.parent = node;
+            goal.parent_worker = worker->index;
+            goal.player = player;
+            goal.g = g + pushes;
+            goal.f = g + pushes;
+            goal.box_from = from;
+            goal.direction = d;
+            goal.macro = macro;
+            goal.symmetry = level->symmetry.compose[symmetry][solver->nodes[node].symmetry];
+
+            found_parallel_goal(worker, &goal, hash);
+            best = SDL_AtomicGet(&search->best_g);
+            continue;
+        }
+
+        // Trusts the hash without looking at the boxes, which only the owner can do.
+        int known_g;
+        unsigned int known_node;
+        if (owner != worker->index && transposition_lookup(solver->table, hash, &known_g, &known_node) && known_g <= g + pushes) continue;
+
+        Parallel_Message *message = owner == worker->index ? worker->local_message : reserve_bytes(&worker->outboxes[owner], search->message_size);
+        message->box_hash = box_hash;
+        message->parent = node;
+        message->parent_worker = worker->index;
+        message->player = player;
+        message->g = g + pushes;
+        message->f = g + pushes + h;
+        message->box_from = from;
+        message->direction = d;
+        message->macro = macro;
+        message->symmetry = level->symmetry.compose[symmetry][solver->nodes[node].symmetry];
+        memcpy(message->boxes, child_boxes, sizeof(int) * level->box_count);
+
+        sent += 1;
+
+        if (owner == worker->index) {
+            absorb_message(worker, message);
+            continue;
+        }
+
+        int key = front_key(message->f, message->g);
+        if (key < worker->outbox_front) worker->outbox_front = key;
+        if (worker->outboxes[owner].used >= PARALLEL_FLUSH_BYTES) flush_outbox(worker, owner);
+    }
+
+    // The children in and this node out in one step.
+    SDL_AtomicAdd(&search->outstanding, sent - 1);
+}
+
+// The smallest front of any worker, how far the search as a whole has got. The worker whose front
+// it is never waits for it, so someone always gets to expand.
+int parallel_front(Parallel_Search *search)
+{
+    int front = PARALLEL_NO_FRONT;
+    for (int w = 0; w < search->worker_count; w += 1)
+    {
+        int key = SDL_AtomicGet(&search->workers[w].front);
+        if (key < front) front = key;
+    }
+    return front;
+}
+
+bool parallel_out_of_budget(Parallel_Search *search)
+{
+    Solver_Options *options = search->options;
+    long long expanded = (long long)SDL_AtomicAdd(&search->expanded_blocks, 1) * 1024 + 1024;
+
+    if (options->max_nodes && expanded >= options->max_nodes) return true;
+    if (options->time_limit > 0 && solver_seconds() - search->start > options->time_limit) return true;
+    return false;
+}
+
+int parallel_worker(void *data)
+{
+    Parallel_Worker *worker = data;
+    Parallel_Search *search = worker->search;
+    Solver *solver = &worker->solver;
+
+    while (!SDL_AtomicGet(&search->stop))
+    {
+        receive_messages(worker);
+
+        // Nothing left here can beat the best solution.
+        if (solver->heap_count > 0 && solver->heap[0].f >= SDL_AtomicGet(&search->best_g)) {
+            worker->finished += solver->heap_count;
+            solver->heap_count = 0;
+        }
+
+        int front = solver->heap_count > 0 ? front_key(solver->heap[0].f, solver->heap[0].g) : PARALLEL_NO_FRONT;
+        SDL_AtomicSet(&worker->front, front < worker->outbox_front ? front : worker->outbox_front);
+
+        if (solver->heap_count == 0) {
+            flush_outboxes(worker);
+
+            if (worker->finished) {
+                SDL_AtomicAdd(&search->outstanding, -worker->finished);
+                worker->finished = 0;
+            }
+
+            if (SDL_AtomicGet(&search->outstanding) == 0) break;
+
+            SDL_Delay(0);
+            continue;
+        }
+
+        // Keeps to the order one worker would take, see the top of the file. What is in the outboxes
+        // has to go out for the worker with it to get on.
+        if (front > parallel_front(search)) {
+            flush_outboxes(worker);
+            SDL_Delay(0);
+            continue;
+        }
+
+        Heap_Entry entry = heap_pop(solver);
+        int node = entry.node;
+
+        if (entry.g != solver->nodes[node].g) {
+            worker->finished += 1;
+            continue;
+        }
+
+        // Only the start can be solved here, every other solved position is caught when it is generated.
+        boxes_of(solver, node, worker->boxes);
+        if (is_solved_position(search->level, worker->boxes)) {
+            found_parallel_goal(worker, &solver->nodes[node], node_hash(solver, node));
+            worker->finished += 1;
+            continue;
+        }
+
+        expand_parallel(worker, node);
+        worker->expanded += 1;
+
+        // Keep the other workers fed even while this one has plenty to do.
+        if ((worker->expanded & 63) == 0) flush_outboxes(worker);
+
+        if ((worker->expanded & 1023) == 0 && parallel_out_of_budget(search)) {
+            SDL_AtomicSet(&search->gave_up, 1);
+            SDL_AtomicSet(&search->stop, 1);
+        }
+    }
+
+    return 0;
+}
+
+// Follows the parent links across the workers' node stores back to the start.
+void build_parallel_solution(Parallel_Search *search, Solver_Node *goal, Solver_Result *result)
+{
+    int push_count = 0;
+    int capacity = 64;
+    Solver_Node **pushes = malloc(sizeof(Solver_Node *) * capacity);
+
+    for (Solver_Node *node = goal; node->parent != -1; node = &search->workers[node->parent_worker].solver.nodes[node->parent])
+    {
+        if (push_count == capacity) {
+            capacity *= 2;
+            pushes = realloc(pushes, sizeof(Solver_Node *) * capacity);
+        }
+        pushes[push_count++] = node;
+    }
+
+    for (int p = 0; p < push_count / 2; p += 1)
+    {
+        Solver_Node *swap = pushes[p];
+        pushes[p] = pushes[push_count - 1 - p];
+        pushes[push_count - 1 - p] = swap;
+    }
+
+    build_moves(&search->workers[0].solver, pushes, push_count, result);
+    free(pushes);
+}
+
+// Replaces the moves with the first solution a single threaded IDA* iteration under the same push
+// count finds. It can only miss one if two positions share a 64 bit key, and then the workers'
+// moves stay. Budgets, the table size and the checkpoint are the search's, not this pass's.
+void replay_parallel_solution(Solver_Level *level, Solver_Options *options, Solver_Result *result)
+{
+    Solver_Options replay = *options;
+    replay.max_nodes = 0;
+    replay.time_limit = 0;
+    replay.table_megabytes = 0;
+    replay.checkpoint_file = NULL;
+    replay.cancel = NULL;
+
+    Solver_Result found = solve_level_ida_from(level, &replay, result->push_count);
+
+    if (found.solved && found.push_count == result->push_count) {
+        free(result->moves);
+        result->moves = found.moves;
+        result->move_count = found.move_count;
+    } else {
+        free_solver_result(&found);
+    }
+}
+
+Solver_Result solve_level_parallel(Solver_Level *level, Solver_Options *options)
+{
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    Parallel_Search search;
+    memset(&search, 0, sizeof(search));
+    search.level = level;
+    search.options = options;
+    search.start = solver_seconds();
+    search.worker_count = options->threads < PARALLEL_MAX_WORKERS ? options->threads : PARALLEL_MAX_WORKERS;
+    search.message_size = (sizeof(Parallel_Message) + sizeof(int) * level->box_count + 7) & ~(size_t)7;
+    SDL_AtomicSet(&search.best_g, SOLVER_INFINITY);
+
+    if (!init_solver_table(&search.table, options)) {
+        result.gave_up = true;
+        return result;
+    }
+
+    search.workers = calloc(search.worker_count, sizeof(Parallel_Worker));
+    for (int w = 0; w < search.worker_count; w += 1)
+    {
+        Parallel_Worker *worker = &search.workers[w];
+        worker->search = &search;
+        worker->index = w;
+        init_solver(&worker->solver, level, &search.table, options);
+        worker->boxes = malloc(sizeof(int) * (level->box_count + 1));
+        worker->local_message = malloc(search.message_size);
+        worker->inbox_lock = SDL_CreateMutex();
+        worker->outboxes = calloc(search.worker_count, sizeof(Parallel_Buffer));
+        worker->goal.g = SOLVER_INFINITY;
+        SDL_AtomicSet(&worker->front, PARALLEL_NO_FRONT);
+        worker->outbox_front = PARALLEL_NO_FRONT;
+    }
+
+    // The start position goes to its owner like any other.
+    Parallel_Worker *first = &search.workers[0];
+    Parallel_Message *root = first->local_message;
+    memcpy(root->boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(root->boxes, level->box_count, sizeof(int), compare_ints);
+    root->player = flood_player(&first->solver, root->boxes, level->start_player);
+    root->box_hash = hash_boxes(level, root->boxes);
+    root->symmetry = canonical_symmetry(&first->solver, root->boxes, &root->box_hash, &root->player);
+    turn_boxes(level, root->symmetry, root->boxes);
+    first->solver.start_symmetry = root->symmetry;
+    root->parent = -1;
+    root->parent_worker = 0;
+    root->g = 0;
+    root->f = lower_bound(&first->solver, root->boxes);
+    root->box_from = -1;
+    root->direction = 0;
+    root->macro = 0;
+
+    if (root->f < SOLVER_INFINITY) {
+        Parallel_Worker *owner = &search.workers[owner_of(&search, root->box_hash ^ level->player_keys[root->player])];
+        absorb_message(owner, root);
+        SDL_AtomicSet(&search.outstanding, 1);
+
+        SDL_Thread *threads[PARALLEL_MAX_WORKERS];
+        for (int w = 0; w < search.worker_count; w += 1)
+        {
+            threads[w] = SDL_CreateThread(parallel_worker, "solver", &search.workers[w]);
+        }
+
+        for (int w = 0; w < search.worker_count; w += 1)
+        {
+            SDL_WaitThread(threads[w], NULL);
+        }
+    }
+
+    // Summed in worker order so the report reads the same run to run.
+    int goal_worker = -1;
+    for (int w = 0; w < search.worker_count; w += 1)
+    {
+        Parallel_Worker *worker = &search.workers[w];
+
+        result.nodes_expanded += worker->expanded;
+        result.nodes_generated += worker->generated;
+        result.table.claimed += worker->solver.table_stats.claimed;
+        result.table.inserts += worker->solver.table_stats.inserts;
+        result.table.improvements += worker->solver.table_stats.improvements;
+        result.table.duplicates += worker->solver.table_stats.duplicates;
+        result.table.replacements += worker->solver.table_stats.replacements;
+        result.table.cas_failures += worker->solver.table_stats.cas_failures;
+        add_deadlock_stats(&result.deadlocks, &worker->solver.deadlock_stats);
+        result.reach_updates += worker->solver.reach.updates;
+        result.reach_splits += worker->solver.reach.splits;
+        result.reach_fills += worker->solver.reach.fills;
+        result.tunnel_runs += worker->solver.tunnel_runs;
+        result.room_fills += worker->solver.room_fills;
+
+        if (worker->goal.g == SOLVER_INFINITY) continue;
+
+        if (goal_worker == -1 || worker->goal.g < search.workers[goal_worker].goal.g ||
+            (worker->goal.g == search.workers[goal_worker].goal.g && worker->goal_key < search.workers[goal_worker].goal_key)) {
+            goal_worker = w;
+        }
+    }
+
+    result.gave_up = SDL_AtomicGet(&search.gave_up) != 0;
+
+    // A solution found before giving up is not known to be the shortest, so it does not count, like in solve_level.
+    if (goal_worker != -1 && !result.gave_up) {
+        result.solved = true;
+        build_parallel_solution(&search, &search.workers[goal_worker].goal, &result);
+    }
+
+    result.table_bytes = search.table.bytes;
+    result.table_load = transposition_load(&search.table, result.table.claimed);
+
+    for (int w = 0; w < search.worker_count; w += 1)
+    {
+        Parallel_Worker *worker = &search.workers[w];
+        free_solver(&worker->solver);
+        free(worker->boxes);
+        free(worker->local_message);
+        SDL_DestroyMutex(worker->inbox_lock);
+        free(worker->inbox.data);
+        free(worker->spare.data);
+        for (int d = 0; d < search.worker_count; d += 1) free(worker->outboxes[d].data);
+        free(worker->outboxes);
+    }
+
+    free(search.workers);
+    free_transposition_table(&search.table);
+
+    // After the workers' memory is back, since the pass has a table of its own.
+    if (result.solved) replay_parallel_solution(level, options, &result);
+
+    result.seconds = solver_seconds() - search.start;
+    return result;
+}
@@ -0,0 +1,646 @@
+//
+// Pattern databases: exact push costs for small groups of goals, built
+// once per level and cached on disk.
+//
+// The goals are split into disjoint groups of a few goals each, nearest
+// together first. For every group there is a table with the fewest pushes
+// that put boxes on all of its goals, for every way of placing that many
+// boxes on the level with nothing else on it. The table is filled by
+// pulling boxes backwards from the goals, breadth first. The player is
+// taken to be wherever it needs to be, which keeps a state down to its box
+// cells and the tables small; the boxes in a group still block each other,
+// which is what the matching can not see.
+//
+// In a real solution every goal group gets its own boxes, so the best
+// entry for each group, over every choice of boxes, summed over the
+// groups, is a lower bound. The solver uses the larger of it and the
+// matching.
+//
+// Tables are one byte per entry, indexed by the combinatorial number of the
+// boxes' live cells (cells a box can still get to a goal from). They go to
+// one file per level, named by the level hash, which later runs map
+// straight into memory instead of building again. Groups are built on as
+// many threads as the solver is allowed.
+//
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define PATTERN_MAX_BOXES 3
+
+// Entries per group table. Levels that would need more get smaller groups.
+#define PATTERN_MAX_ENTRIES (1LL << 22)
+
+// Never reached by pulling, so no set of boxes in that place can fill the group.
+#define PATTERN_UNREACHED 255
+#define PATTERN_MAX_COST 254
+
+#define PATTERN_MAGIC "SOKOPDB"
+#define PATTERN_VERSION 1
+
+typedef struct {
+    int size;
+    int goals[PATTERN_MAX_BOXES];
+    long long entry_count;
+    // Where the group's table starts in the tables.
+    long long offset;
+} Pattern_Group;
+
+// The cache file is this header, the groups, the level's cells and then the tables.
+typedef struct {
+    char magic[8];
+    int version;
+    int group_size;
+    unsigned long long level_hash;
+    int w;
+    int cell_count;
+    int live_count;
+    int group_count;
+    long long table_offset;
+    long long table_bytes;
+} Pattern_Header;
+
+typedef struct {
+    int group_size;
+    int group_count;
+    Pattern_Group *groups;
+    unsigned char *tables;
+    long long table_bytes;
+
+    // Cell to live cell number, -1 for cells no box can reach a goal from.
+    int *live_index;
+    int *live_cells;
+    int live_count;
+
+    // The tables are either a mapped cache file or memory of our own.
+    void *mapping;
+    size_t mapping_bytes;
+    void *mapping_handle;
+    Pattern_Group *owned_groups;
+    unsigned char *owned_tables;
+
+    bool from_cache;
+    double build_seconds;
+} Pattern_Database;
+
+// Per searching thread.
+typedef struct {
+    int *live;
+    // without[group * box_count + b]: the group's best entry over sets of boxes not using box b.
+    int *without;
+} Pattern_Scratch;
+
+//
+// Indexing
+//
+
+long long choose(long long n, int k)
+{
+    if (n < k) return 0;
+
+    long long result = 1;
+    for (int i = 0; i < k; i += 1) result = result * (n - i) / (i + 1);
+    return result;
+}
+
+// Index of a set of live cells, given in increasing order.
+long long pattern_rank(int *live, int size)
+{
+    long long rank = 0;
+    for (int i = 0; i < size; i += 1) rank += choose(live[i], i + 1);
+    return rank;
+}
+
+void sort_small(int *values, int count)
+{
+    for (int i = 1; i < count; i += 1)
+    {
+        for (int k = i; k > 0 && values[k - 1] > values[k]; k -= 1)
+        {
+            int swap = values[k];
+            values[k] = values[k - 1];
+            values[k - 1] = swap;
+        }
+    }
+}
+
+// Steps index[0..r) to the next r of 0..m-1 in order. False when there are no more.
+bool next_combination(int *index, int r, int m)
+{
+    int i = r - 1;
+    while (i >= 0 && index[i] == m - r + i) i -= 1;
+    if (i < 0) return false;
+
+    index[i] += 1;
+    for (int k = i + 1; k < r; k += 1) index[k] = index[k - 1] + 1;
+    return true;
+}
+
+//
+// Building
+//
+
+typedef struct {
+    Pattern_Database *database;
+    unsigned char *cells;
+    int *offsets;
+    SDL_atomic_t next_group;
+} Pattern_Build;
+
+// Pulls boxes backwards from the group's goals until every set of boxes that can fill it has its cost.
+void build_pattern_group(Pattern_Build *build, Pattern_Group *group)
+{
+    Pattern_Database *database = build->database;
+    unsigned char *costs = &database->tables[group->offset];
+    int size = group->size;
+
+    memset(costs, PATTERN_UNREACHED, group->entry_count);
+
+    // Live cell numbers packed 21 bits each, which PATTERN_MAX_ENTRIES keeps them under.
+    unsigned long long *queue = malloc(sizeof(unsigned long long) * group->entry_count);
+    long long head = 0, tail = 0;
+
+    int live[PATTERN_MAX_BOXES];
+    for (int i = 0; i < size; i += 1) live[i] = database->live_index[group->goals[i]];
+    sort_small(live, size);
+
+    costs[pattern_rank(live, size)] = 0;
+
+    unsigned long long packed = 0;
+    for (int i = 0; i < size; i += 1) packed |= (unsigned long long)live[i] << (21 * i);
+    queue[tail++] = packed;
+
+    while (head < tail)
+    {
+        packed = queue[head++];
+
+        int boxes[PATTERN_MAX_BOXES];
+        for (int i = 0; i < size; i += 1)
+        {
+            live[i] = (int)((packed >> (21 * i)) & 0x1fffff);
+            boxes[i] = database->live_cells[live[i]];
+        }
+
+        int cost = costs[pattern_rank(live, size)];
+        int next_cost = cost < PATTERN_MAX_COST ? cost + 1 : PATTERN_MAX_COST;
+
+        for (int b = 0; b < size; b += 1)
+        {
+            for (int d = 0; d < 4; d += 1)
+            {
+                // The player steps from `to` to `stand` and the box follows it onto `to`.
+                int to = boxes[b] + build->offsets[d];
+                int stand = to + build->offsets[d];
+
+                if ((build->cells[to] & SOLVER_WALL) || (build->cells[stand] & SOLVER_WALL)) continue;
+
+                bool blocked = false;
+                for (int other = 0; other < size; other += 1)
+                {
+                    if (boxes[other] == to || boxes[other] == stand) blocked = true;
+                }
+                if (blocked || database->live_index[to] < 0) continue;
+
+                int next[PATTERN_MAX_BOXES];
+                memcpy(next, live, sizeof(int) * size);
+                next[b] = database->live_index[to];
+                sort_small(next, size);
+
+                long long rank = pattern_rank(next, size);
+                if (costs[rank] != PATTERN_UNREACHED) continue;
+
+                costs[rank] = (unsigned char)next_cost;
+
+                unsigned long long next_packed = 0;
+                for (int i = 0; i < size; i += 1) next_packed |= (unsigned long long)next[i] << (21 * i);
+                queue[tail++] = next_packed;
+            }
+        }
+    }
+
+    free(queue);
+}
+
+int pattern_build_worker(void *data)
+{
+    Pattern_Build *build = data;
+
+    for (;;)
+    {
+        int g = SDL_AtomicAdd(&build->next_group, 1);
+        if (g >= build->database->group_count) break;
+
+        build_pattern_group(build, &build->database->groups[g]);
+    }
+
+    return 0;
+}
+
+// Numbers the cells a box can still reach a goal from, in cell order, so sorted boxes have sorted numbers.
+void find_live_cells(Pattern_Database *database, int *nearest_goal, int cell_count)
+{
+    database->live_index = malloc(sizeof(int) * cell_count);
+    database->live_cells = malloc(sizeof(int) * cell_count);
+    database->live_count = 0;
+
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        database->live_index[c] = -1;
+
+        if (nearest_goal[c] < SOLVER_INFINITY) {
+            database->live_index[c] = database->live_count;
+            database->live_cells[database->live_count] = c;
+            database->live_count += 1;
+        }
+    }
+}
+
+// Groups of up to `group_size` goals, each one grown from the first goal left by adding the goals
+// nearest to it in pushes, so the boxes that get in each other's way end up in one group.
+void group_goals(Pattern_Database *database, int *goals, int goal_count, int *distances)
+{
+    bool *taken = calloc(goal_count, sizeof(bool));
+    database->groups = database->owned_groups = calloc(goal_count, sizeof(Pattern_Group));
+    database->group_count = 0;
+
+    for (int seed = 0; seed < goal_count; seed += 1)
+    {
+        if (taken[seed]) continue;
+
+        Pattern_Group *group = &database->groups[database->group_count++];
+        group->goals[0] = goals[seed];
+        group->size = 1;
+        taken[seed] = true;
+
+        while (group->size < database->group_size)
+        {
+            int nearest = -1;
+            long long nearest_distance = 0;
+
+            for (int g = 0; g < goal_count; g += 1)
+            {
+                if (taken[g]) continue;
+
+                long long distance = (long long)distances[(size_t)goals[g] * goal_count + seed] +
+                                     distances[(size_t)goals[seed] * goal_count + g];
+
+                if (nearest == -1 || distance < nearest_distance) {
+                    nearest = g;
+                    nearest_distance = distance;
+                }
+            }
+
+            if (nearest == -1) break;
+
+            group->goals[group->size++] = goals[nearest];
+            taken[nearest] = true;
+        }
+    }
+
+    free(taken);
+}
+
+void build_pattern_database(Pattern_Database *database, unsigned char *cells, int *offsets,
+                            int *goals, int goal_count, int *distances, int threads)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    group_goals(database, goals, goal_count, distances);
+
+    long long table_bytes = 0;
+    for (int g = 0; g < database->group_count; g += 1)
+    {
+        Pattern_Group *group = &database->groups[g];
+        group->entry_count = choose(database->live_count, group->size);
+        group->offset = table_bytes;
+        table_bytes += group->entry_count;
+    }
+
+    database->tables = database->owned_tables = malloc(table_bytes > 0 ? table_bytes : 1);
+    database->table_bytes = table_bytes;
+
+    Pattern_Build build;
+    build.database = database;
+    build.cells = cells;
+    build.offsets = offsets;
+    SDL_AtomicSet(&build.next_group, 0);
+
+    if (threads > database->group_count) threads = database->group_count;
+    if (threads > 64) threads = 64;
+
+    SDL_Thread *workers[64];
+    for (int t = 1; t < threads; t += 1) workers[t] = SDL_CreateThread(pattern_build_worker, "patterns", &build);
+    pattern_build_worker(&build);
+    for (int t = 1; t < threads; t += 1) SDL_WaitThread(workers[t], NULL);
+
+    database->build_seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+//
+// Cache file
+//
+
+void *map_file(char *filename, size_t *bytes, void **handle)
+{
+#ifdef _MSC_VER
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+
+    *bytes = (size_t)size.QuadPart;
+    *handle = mapping;
+    return data;
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0) return NULL;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        close(file);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) return NULL;
+
+    *bytes = (size_t)status.st_size;
+    *handle = NULL;
+    return data;
+#endif
+}
+
+void unmap_file(void *data, size_t bytes, void *handle)
+{
+#ifdef _MSC_VER
+    UnmapViewOfFile(data);
+    CloseHandle(handle);
+#else
+    (void)handle;
+    munmap(data, bytes);
+#endif
+}
+
+void pattern_filename(char *out, size_t out_size, char *directory, unsigned long long level_hash, int group_size)
+{
+    snprintf(out, out_size, "%s/patterns_%016llx_%d.patterns", directory ? directory : ".", level_hash, group_size);
+}
+
+long long pattern_table_offset(int group_count, int cell_count)
+{
+    long long offset = sizeof(Pattern_Header) + sizeof(Pattern_Group) * (long long)group_count + cell_count;
+    return (offset + 7) & ~7LL;
+}
+
+// Uses the cached tables if the file is there and was built for exactly these cells.
+bool load_pattern_database(Pattern_Database *database, char *filename, unsigned long long level_hash,
+                           unsigned char *cells, int w, int cell_count)
+{
+    size_t bytes;
+    void *handle;
+    unsigned char *data = map_file(filename, &bytes, &handle);
+    if (!data) return false;
+
+    Pattern_Header *header = (Pattern_Header *)data;
+    bool valid = bytes >= sizeof(Pattern_Header) &&
+                 !memcmp(header->magic, PATTERN_MAGIC, sizeof(header->magic)) &&
+                 header->version == PATTERN_VERSION &&
+                 header->group_size == database->group_size &&
+                 header->level_hash == level_hash &&
+                 header->w == w &&
+                 header->cell_count == cell_count &&
+                 header->live_count == database->live_count &&
+                 header->group_count >= 0 && header->table_bytes >= 0 &&
+                 header->table_offset == pattern_table_offset(header->group_count, cell_count) &&
+                 (long long)bytes >= header->table_offset + header->table_bytes;
+
+    if (valid) {
+        unsigned char *file_cells = data + sizeof(Pattern_Header) + sizeof(Pattern_Group) * header->group_count;
+        valid = !memcmp(file_cells, cells, cell_count);
+    }
+
+    // The groups are trusted from here on, so every rank a lookup can make has to land in the tables.
+    if (valid) {
+        Pattern_Group *groups = (Pattern_Group *)(data + sizeof(Pattern_Header));
+        for (int g = 0; g < header->group_count && valid; g += 1)
+        {
+            Pattern_Group *group = &groups[g];
+            valid = group->size >= 1 && group->size <= database->group_size && group->size <= PATTERN_MAX_BOXES &&
+                    group->entry_count == choose(database->live_count, group->size) &&
+                    group->offset >= 0 && group->offset <= header->table_bytes &&
+                    group->entry_count <= header->table_bytes - group->offset;
+        }
+    }
+
+    if (!valid) {
+        unmap_file(data, bytes, handle);
+        return false;
+    }
+
+    database->group_count = header->group_count;
+    database->groups = (Pattern_Group *)(data + sizeof(Pattern_Header));
+    database->tables = data + header->table_offset;
+    database->table_bytes = header->table_bytes;
+    database->mapping = data;
+    database->mapping_bytes = bytes;
+    database->mapping_handle = handle;
+    database->from_cache = true;
+
+    return true;
+}
+
+// Written under a temporary name and renamed, so a run that dies halfway never leaves a bad cache.
+bool save_pattern_database(Pattern_Database *database, char *filename, unsigned long long level_hash,
+                           unsigned char *cells, int w, int cell_count)
+{
+    char temporary[1024];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", filename);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) return false;
+
+    Pattern_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PATTERN_MAGIC, sizeof(header.magic));
+    header.version = PATTERN_VERSION;
+    header.group_size = database->group_size;
+    header.level_hash = level_hash;
+    header.w = w;
+    header.cell_count = cell_count;
+    header.live_count = database->live_count;
+    header.group_count = database->group_count;
+    header.table_offset = pattern_table_offset(database->group_count, cell_count);
+    header.table_bytes = database->table_bytes;
+
+    long long written = sizeof(header) + sizeof(Pattern_Group) * (long long)database->group_count + cell_count;
+    char padding[8] = {0};
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(database->groups, sizeof(Pattern_Group), database->group_count, file) == (size_t)database->group_count;
+    ok = ok && fwrite(cells, 1, cell_count, file) == (size_t)cell_count;
+    ok = ok && fwrite(padding, 1, header.table_offset - written, file) == (size_t)(header.table_offset - written);
+    ok = ok && fwrite(database->tables, 1, database->table_bytes, file) == (size_t)database->table_bytes;
+    ok = fclose(file) == 0 && ok;
+
+    remove(filename);
+    if (!ok || rename(temporary, filename) != 0) {
+        remove(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+void free_pattern_database(Pattern_Database *database)
+{
+    if (database->mapping) unmap_file(database->mapping, database->mapping_bytes, database->mapping_handle);
+
+    free(database->owned_groups);
+    free(database->owned_tables);
+    free(database->live_index);
+    free(database->live_cells);
+    memset(database, 0, sizeof(*database));
+}
+
+//
+// Lookups
+//
+
+void init_pattern_scratch(Pattern_Scratch *scratch, Pattern_Database *database, int box_count)
+{
+    scratch->live = malloc(sizeof(int) * (box_count + 1));
+    scratch->without = malloc(sizeof(int) * ((size_t)database->group_count * box_count + 1));
+}
+
+void free_pattern_scratch(Pattern_Scratch *scratch)
+{
+    free(scratch->live);
+    free(scratch->without);
+}
+
+// Sum over the groups of their best entry, or SOLVER_INFINITY if a group can not be filled.
+// Remembers, for every box, each group's best without that box, for child_pattern_bound.
+int pattern_bound(Pattern_Database *database, Pattern_Scratch *scratch, int *boxes, int box_count)
+{
+    if (database->group_count == 0) return 0;
+
+    // Boxes on dead cells can not be in any group's set.
+    int live_count = 0;
+    int *live_box = scratch->live;
+    for (int b = 0; b < box_count; b += 1)
+    {
+        if (database->live_index[boxes[b]] >= 0) live_box[live_count++] = b;
+    }
+
+    int total = 0;
+
+    for (int g = 0; g < database->group_count; g += 1)
+    {
+        Pattern_Group *group = &database->groups[g];
+        unsigned char *costs = &database->tables[group->offset];
+        int *without = &scratch->without[(size_t)g * box_count];
+        int best = PATTERN_UNREACHED;
+
+        for (int b = 0; b < box_count; b += 1) without[b] = PATTERN_UNREACHED;
+
+        if (live_count < group->size) return SOLVER_INFINITY;
+
+        int index[PATTERN_MAX_BOXES];
+        for (int i = 0; i < group->size; i += 1) index[i] = i;
+
+        do
+        {
+            int live[PATTERN_MAX_BOXES];
+            for (int i = 0; i < group->size; i += 1) live[i] = database->live_index[boxes[live_box[index[i]]]];
+
+            int cost = costs[pattern_rank(live, group->size)];
+            if (cost == PATTERN_UNREACHED) continue;
+            if (cost < best) best = cost;
+
+            int at = 0;
+            for (int b = 0; b < box_count; b += 1)
+            {
+                if (at < group->size && live_box[index[at]] == b) {
+                    at += 1;
+                    continue;
+                }
+
+                if (cost < without[b]) without[b] = cost;
+            }
+        } while (next_combination(index, group->size, live_count));
+
+        if (best == PATTERN_UNREACHED) return SOLVER_INFINITY;
+        total += best;
+    }
+
+    return total;
+}
+
+// The bound once box b of the last pattern_bound call is on `to`. Only the sets with the moved box need looking up.
+int child_pattern_bound(Pattern_Database *database, Pattern_Scratch *scratch, int *boxes, int box_count, int b, int to)
+{
+    if (database->group_count == 0) return 0;
+
+    int to_live = database->live_index[to];
+
+    int others = 0;
+    int *other_box = scratch->live;
+    for (int other = 0; other < box_count; other += 1)
+    {
+        if (other != b && database->live_index[boxes[other]] >= 0) other_box[others++] = other;
+    }
+
+    int total = 0;
+
+    for (int g = 0; g < database->group_count; g += 1)
+    {
+        Pattern_Group *group = &database->groups[g];
+        unsigned char *costs = &database->tables[group->offset];
+        int best = scratch->without[(size_t)g * box_count + b];
+        int rest = group->size - 1;
+
+        if (to_live >= 0 && others >= rest) {
+            int index[PATTERN_MAX_BOXES];
+            for (int i = 0; i < rest; i += 1) index[i] = i;
+
+            do
+            {
+                int live[PATTERN_MAX_BOXES];
+                for (int i = 0; i < rest; i += 1) live[i] = database->live_index[boxes[other_box[index[i]]]];
+                live[rest] = to_live;
+                sort_small(live, group->size);
+
+                int cost = costs[pattern_rank(live, group->size)];
+                if (cost < best) best = cost;
+            } while (next_combination(index, rest, others));
+        }
+
+        if (best == PATTERN_UNREACHED) return SOLVER_INFINITY;
+        total += best;
+    }
+
+    return total;
+}
@@ -0,0 +1,125 @@
+//
+// Portfolio search for one level: the searches race on threads of their own,
+// and the first to finish stops the others.
+//
+// No one search is best on every level. On the levels it was tried on,
+// plain A* came first on most small ones, IDA* where nodes are costly but
+// few, the anytime search on some, and the bidirectional search on one
+// where it expands a third of what A* does. Each of them only stops with
+// the fewest pushes or with proof there is no solution, so whichever
+// finishes first has the answer, and the others are told to give up
+// through Solver_Options.cancel, which they look at every node.
+//
+// The threads take a core each. On fewer cores they share them, and the
+// first search to finish takes about as many times longer as there are
+// searches sharing its core.
+//
+// They share the Solver_Level: the dead squares, wall lines, push distances
+// and pattern databases are built before the threads start and only read
+// after. Everything a search writes, its nodes, table and deadlock scratch,
+// is its own, so each takes the memory it would alone.
+//
+// The result is the winner's, counters and all, with the time it took the
+// portfolio. When every search runs out of budget, a solution the anytime
+// search had is kept, marked as maybe not the fewest like its own.
+//
+
+typedef enum {
+    PORTFOLIO_ASTAR,
+    PORTFOLIO_ANYTIME,
+    PORTFOLIO_BIDIRECTIONAL,
+    PORTFOLIO_IDA,
+    PORTFOLIO_STRATEGY_COUNT,
+} Portfolio_Strategy;
+
+char *portfolio_names[PORTFOLIO_STRATEGY_COUNT] = {"A*", "anytime", "bidirectional", "IDA*"};
+
+typedef struct {
+    Solver_Level *level;
+
+    SDL_atomic_t cancel;
+    // The first strategy to finish, -1 until one does.
+    SDL_atomic_t winner;
+} Portfolio;
+
+typedef struct {
+    Portfolio *portfolio;
+    Portfolio_Strategy strategy;
+    Solver_Options options;
+    Solver_Result result;
+} Portfolio_Run;
+
+int portfolio_run(void *data)
+{
+    Portfolio_Run *run = data;
+    Solver_Level *level = run->portfolio->level;
+
+    switch (run->strategy)
+    {
+        case PORTFOLIO_ASTAR:         run->result = solve_level(level, &run->options); break;
+        case PORTFOLIO_ANYTIME:       run->result = solve_level_anytime(level, &run->options); break;
+        case PORTFOLIO_BIDIRECTIONAL: run->result = solve_level_bidirectional(level, &run->options); break;
+        case PORTFOLIO_IDA:           run->result = solve_level_ida(level, &run->options); break;
+        default: break;
+    }
+
+    // Solved or shown to have no solution, either way there is nothing left to race for.
+    if (!run->result.gave_up && SDL_AtomicCAS(&run->portfolio->winner, -1, run->strategy)) {
+        SDL_AtomicSet(&run->portfolio->cancel, 1);
+    }
+
+    return 0;
+}
+
+Solver_Result solve_level_portfolio(Solver_Level *level, Solver_Options *options)
+{
+    double start = solver_seconds();
+
+    Portfolio portfolio;
+    memset(&portfolio, 0, sizeof(portfolio));
+    portfolio.level = level;
+    SDL_AtomicSet(&portfolio.winner, -1);
+
+    Portfolio_Run runs[PORTFOLIO_STRATEGY_COUNT];
+    SDL_Thread *threads[PORTFOLIO_STRATEGY_COUNT];
+
+    for (int s = 0; s < PORTFOLIO_STRATEGY_COUNT; s += 1)
+    {
+        Portfolio_Run *run = &runs[s];
+        memset(run, 0, sizeof(*run));
+        run->portfolio = &portfolio;
+        run->strategy = s;
+
+        run->options = *options;
+        run->options.threads = 0;
+        run->options.portfolio = false;
+        run->options.external = false;
+        run->options.bidirectional = s == PORTFOLIO_BIDIRECTIONAL;
+        run->options.ida = s == PORTFOLIO_IDA;
+        run->options.anytime = s == PORTFOLIO_ANYTIME;
+        run->options.cancel = &portfolio.cancel;
+
+        threads[s] = SDL_CreateThread(portfolio_run, "portfolio", run);
+    }
+
+    for (int s = 0; s < PORTFOLIO_STRATEGY_COUNT; s += 1)
+    {
+        SDL_WaitThread(threads[s], NULL);
+    }
+
+    int winner = SDL_AtomicGet(&portfolio.winner);
+
+    int kept = winner;
+    if (kept == -1) kept = runs[PORTFOLIO_ANYTIME].result.solved ? PORTFOLIO_ANYTIME : PORTFOLIO_ASTAR;
+
+    for (int s = 0; s < PORTFOLIO_STRATEGY_COUNT; s += 1)
+    {
+        if (s != kept) free_solver_result(&runs[s].result);
+    }
+
+    Solver_Result result = runs[kept].result;
+    result.portfolio_strategies = PORTFOLIO_STRATEGY_COUNT;
+    result.portfolio_winner = winner;
+    result.seconds = solver_seconds() - start;
+    return result;
+}
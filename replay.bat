@@ -0,0 +1,5 @@
+@echo off
+
+pushd bin
+sokoban.exe --replay ../assets/solutions.txt %*
+popd
@@ -0,0 +1,425 @@
+#define SOKOBAN_NO_MAIN
+#include "main.c"
+#include "solver.c"
+
+//
+// Solves levels and checks the solutions by playing them through apply_event.
+//
+//     solve [LEVEL_FILE...] [--max-nodes N] [--time-limit SECONDS] [--table-mb N] [--threads N]
+//           [--scaling MAX_THREADS] [--no-deadlock KIND] [--pattern-boxes N] [--no-patterns]
+//           [--pattern-cache DIR] [--bidirectional] [--ida] [--checkpoint FILE] [--external]
+//           [--external-dir DIR] [--macros] [--no-symmetry] [--anytime] [--portfolio] [--stats]
+//           [--write-solutions FILE] [--expect-unsolvable]
+//
+// With no files it solves the shipped levels in order. The exit code is
+// non-zero when any level is not solved, so it can gate a level change.
+// With --expect-unsolvable it is the other way round: every level has to be
+// shown to have no solution, which is how test.bat checks the levels in
+// assets/tests.
+//
+// --threads searches with N workers, see parallel.c. It is experimental:
+// it has only been measured on one core, where it is no faster than one.
+//
+// --scaling solves each level with 1, 2, 4 ... up to MAX_THREADS workers
+// and prints the speedup over one, checking every run finds the same push count.
+//
+// --no-deadlock leaves one kind of deadlock check out (dead, freeze, 2x2,
+// lines, corrals or all), to see what it is worth. --stats prints the
+// deadlock, transposition table and pattern database counters under each level.
+//
+// --pattern-boxes sets how many goals go in one pattern database group (2
+// or 3), --no-patterns goes without them. They are cached in
+// --pattern-cache DIR, the working directory by default.
+//
+// --bidirectional searches back from the goals by pulls at the same time,
+// meeting the forward search in the middle.
+//
+// --ida searches depth first under a rising bound, in the memory of the
+// table alone (16 MB unless --table-mb says otherwise). With --checkpoint
+// FILE the bound is saved after every iteration, and a later run on the
+// same level picks up from it. One saved with --macros is only picked up
+// by runs with --macros.
+//
+// --external searches breadth first with the layers in sorted files under
+// --external-dir DIR, the working directory by default, and --table-mb
+// sizing the sort buffer (64 MB by default). A run that is stopped picks up
+// from its last finished layer when started again.
+//
+// --macros pushes a box on along tunnels and into goal rooms in one step.
+// It finds solutions sooner, but not always ones with the fewest pushes.
+//
+// --no-symmetry searches a mirrored or turned level's positions apart from
+// their images, to see what keeping one of each is worth.
+//
+// --anytime finds a solution soon and better ones until --max-nodes or
+// --time-limit, printing each as it comes. A level that runs out first
+// keeps its best solution, marked as maybe not the fewest pushes.
+//
+// --portfolio races the A*, anytime, bidirectional and IDA* searches on a
+// thread each and keeps the first to finish. --stats names the winner, and
+// the wins of each are counted up after the last level.
+//
+
+typedef struct {
+    char *files[64];
+    int file_count;
+
+    Solver_Options solver;
+    char *solutions_out;
+    int scaling;
+    bool stats;
+    bool expect_unsolvable;
+} Solve_Options;
+
+// Plays the moves on a fresh copy of the level, the same way a player would.
+bool verify_solution(char *filename, char *moves)
+{
+    Board board = {0};
+    if (!populate_board_from_file(&board, filename)) return false;
+
+    for (char *move = moves; *move; move += 1)
+    {
+        Direction direction;
+        switch (*move)
+        {
+            case 'w': direction = NORTH; break;
+            case 'a': direction = WEST;  break;
+            case 's': direction = SOUTH; break;
+            case 'd': direction = EAST;  break;
+            default: free_board(&board); return false;
+        }
+
+        apply_event(make_event(MOVE, direction), &board);
+    }
+
+    bool won = check_win_conditions(board);
+
+    // The hash apply_event kept up to date has to match one computed from scratch.
+    if (board.hash != compute_board_hash(&board)) {
+        printf("%s: incremental hash drifted from the board\n", filename);
+        won = false;
+    }
+
+    free_board(&board);
+
+    return won;
+}
+
+void print_usage(void)
+{
+    printf("Usage: solve [LEVEL_FILE...] [--max-nodes N] [--time-limit SECONDS] [--table-mb N] [--threads N]\n");
+    printf("             [--scaling MAX_THREADS] [--no-deadlock KIND] [--pattern-boxes N] [--no-patterns]\n");
+    printf("             [--pattern-cache DIR] [--bidirectional] [--ida] [--checkpoint FILE] [--external]\n");
+    printf("             [--external-dir DIR] [--macros] [--no-symmetry] [--anytime] [--portfolio] [--stats]\n");
+    printf("             [--write-solutions FILE] [--expect-unsolvable]\n");
+    printf("--threads is experimental and not yet known to be faster than one thread.\n");
+}
+
+void print_stats(Solver_Result *result)
+{
+    printf("    deadlocks  ");
+    for (int k = 0; k < DEADLOCK_KIND_COUNT; k += 1)
+    {
+        Deadlock_Counter *counter = &result->deadlocks.kinds[k];
+        printf(" %s %lld/%lld", deadlock_names[k], counter->found, counter->checks);
+        if (counter->over_budget) printf(" (%lld over budget)", counter->over_budget);
+    }
+    printf("\n");
+
+    Transposition_Stats *table = &result->table;
+    printf("    table       %lld MB, %lld new, %lld improved, %lld duplicates, %lld evicted, %lld CAS retries\n",
+           result->table_bytes >> 20, table->inserts, table->improvements, table->duplicates, table->replacements, table->cas_failures);
+
+    printf("    states      %d live cells, %d bytes of boxes per position\n", result->live_cells, result->state_bytes);
+    printf("    reach       %lld regions updated after a move, %lld of them cut, %lld filled\n",
+           result->reach_updates, result->reach_splits, result->reach_fills);
+
+    if (result->pattern_groups) {
+        printf("    patterns    %d groups of up to %d goals, %.1f MB, ",
+               result->pattern_groups, result->pattern_boxes, result->pattern_bytes / (1024.0 * 1024.0));
+        if (result->patterns_cached) printf("mapped from the cache\n");
+        else printf("built in %.1f ms\n", result->pattern_seconds * 1000.0);
+    } else {
+        printf("    patterns    none\n");
+    }
+
+    if (result->symmetries > 1) {
+        printf("    symmetry    %d images per position searched as one\n", result->symmetries);
+    }
+
+    if (result->tunnel_cells || result->goal_rooms) {
+        printf("    macros      %d tunnel cells, %d goal rooms, %lld tunnel runs, %lld rooms filled\n",
+               result->tunnel_cells, result->goal_rooms, result->tunnel_runs, result->room_fills);
+    }
+
+    if (result->backward_expanded) {
+        printf("    search      %lld expanded forward, %lld backward\n",
+               result->nodes_expanded - result->backward_expanded, result->backward_expanded);
+    }
+
+    if (result->anytime_runs) {
+        printf("    anytime     %d runs, %d solutions, last weight %.2f\n",
+               result->anytime_runs, result->anytime_solutions, result->anytime_weight / 100.0);
+    }
+
+    if (result->portfolio_strategies) {
+        printf("    portfolio   %s first of %d\n",
+               result->portfolio_winner >= 0 ? portfolio_names[result->portfolio_winner] : "none", result->portfolio_strategies);
+    }
+
+    if (result->iterations) {
+        printf("    ida         %d iterations, bound %d", result->iterations, result->final_bound);
+        if (result->resumed_bound) printf(", resumed at %d", result->resumed_bound);
+        printf("\n");
+    }
+
+    if (result->external_layers || result->external_bytes) {
+        printf("    external    %d layers, %lld positions, %.1f MB written", result->external_layers, result->external_positions,
+               result->external_bytes / (1024.0 * 1024.0));
+        if (result->resumed_layer) printf(", resumed at layer %d", result->resumed_layer);
+        printf("\n");
+    }
+}
+
+// Prints each better solution of an anytime search, under the level it is for.
+void print_improvement(void *data, char *moves, int push_count, double seconds)
+{
+    printf("    %-24s %8d %8d %40.1f\n", (char *)data, push_count, (int)strlen(moves), seconds * 1000.0);
+}
+
+// Bit for a --no-deadlock name, or 0 if there is no such kind.
+int deadlock_kind_bits(char *name)
+{
+    if (!strcmp(name, "all")) return (1 << DEADLOCK_KIND_COUNT) - 1;
+
+    for (int k = 0; k < DEADLOCK_KIND_COUNT; k += 1)
+    {
+        if (!strcmp(name, deadlock_names[k])) return 1 << k;
+    }
+
+    return 0;
+}
+
+int run_scaling(Solve_Options *options)
+{
+    int failures = 0;
+
+    for (int f = 0; f < options->file_count; f += 1)
+    {
+        char *filename = options->files[f];
+        printf("%s\n", filename);
+        printf("%8s %10s %9s %11s %12s %14s  %s\n", "threads", "ms", "speedup", "efficiency", "expanded", "nodes/s", "solution");
+
+        double one_thread_seconds = 0;
+        int first_push_count = -1;
+
+        // Powers of two, then the maximum itself even when it is not one.
+        int thread_counts[32];
+        int run_count = 0;
+        for (int threads = 1; threads < options->scaling && run_count < 31; threads *= 2) thread_counts[run_count++] = threads;
+        thread_counts[run_count++] = options->scaling;
+
+        for (int run = 0; run < run_count; run += 1)
+        {
+            int threads = thread_counts[run];
+
+            Board board = {0};
+            if (!populate_board_from_file(&board, filename)) {
+                printf("could not load\n");
+                failures += 1;
+                break;
+            }
+
+            Solver_Options solver = options->solver;
+            solver.threads = threads;
+            Solver_Result result = solve_board(&board, &solver);
+            free_board(&board);
+
+            if (threads == 1) one_thread_seconds = result.seconds;
+            double speedup = result.seconds > 0 ? one_thread_seconds / result.seconds : 0;
+            double nodes_per_second = result.seconds > 0 ? result.nodes_expanded / result.seconds : 0;
+
+            char *verdict;
+            if (!result.solved) {
+                verdict = result.gave_up ? "gave up" : "UNSOLVABLE";
+                failures += 1;
+            } else if (!verify_solution(filename, result.moves)) {
+                verdict = "DOES NOT REPLAY";
+                failures += 1;
+            } else if (first_push_count == -1 || first_push_count == result.push_count) {
+                first_push_count = result.push_count;
+                verdict = "ok";
+            } else {
+                verdict = "DIFFERENT PUSH COUNT";
+                failures += 1;
+            }
+
+            printf("%8d %10.1f %9.2f %10.0f%% %12lld %14.0f  %s\n",
+                   threads, result.seconds * 1000.0, speedup, speedup / threads * 100.0, result.nodes_expanded, nodes_per_second, verdict);
+
+            free_solver_result(&result);
+        }
+
+        printf("\n");
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    Solve_Options options;
+    memset(&options, 0, sizeof(options));
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--max-nodes") && has_value) {
+            options.solver.max_nodes = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--time-limit") && has_value) {
+            options.solver.time_limit = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--table-mb") && has_value) {
+            options.solver.table_megabytes = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && has_value) {
+            options.solver.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--scaling") && has_value) {
+            options.scaling = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-deadlock") && has_value) {
+            int bits = deadlock_kind_bits(argv[++i]);
+            if (!bits) {
+                print_usage();
+                return 1;
+            }
+            options.solver.deadlocks.disabled |= bits;
+        } else if (!strcmp(argv[i], "--pattern-boxes") && has_value) {
+            options.solver.pattern_boxes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-patterns")) {
+            options.solver.pattern_boxes = -1;
+        } else if (!strcmp(argv[i], "--pattern-cache") && has_value) {
+            options.solver.pattern_directory = argv[++i];
+        } else if (!strcmp(argv[i], "--bidirectional")) {
+            options.solver.bidirectional = true;
+        } else if (!strcmp(argv[i], "--ida")) {
+            options.solver.ida = true;
+        } else if (!strcmp(argv[i], "--checkpoint") && has_value) {
+            options.solver.checkpoint_file = argv[++i];
+        } else if (!strcmp(argv[i], "--external")) {
+            options.solver.external = true;
+        } else if (!strcmp(argv[i], "--external-dir") && has_value) {
+            options.solver.external_directory = argv[++i];
+        } else if (!strcmp(argv[i], "--macros")) {
+            options.solver.macros = true;
+        } else if (!strcmp(argv[i], "--no-symmetry")) {
+            options.solver.ignore_symmetry = true;
+        } else if (!strcmp(argv[i], "--anytime")) {
+            options.solver.anytime = true;
+        } else if (!strcmp(argv[i], "--portfolio")) {
+            options.solver.portfolio = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            options.stats = true;
+        } else if (!strcmp(argv[i], "--write-solutions") && has_value) {
+            options.solutions_out = argv[++i];
+        } else if (!strcmp(argv[i], "--expect-unsolvable")) {
+            options.expect_unsolvable = true;
+        } else if (argv[i][0] == '-') {
+            print_usage();
+            return 1;
+        } else if (options.file_count < 64) {
+            options.files[options.file_count++] = argv[i];
+        }
+    }
+
+    SDL_Init(SDL_INIT_TIMER);
+
+    static char level_names[64][64];
+    if (options.file_count == 0) {
+        for (int level = 1; level <= 64; level += 1)
+        {
+            sprintf(level_names[level - 1], "../assets/levels/%d.txt", level);
+
+            FILE *file = fopen(level_names[level - 1], "rb");
+            if (!file) break;
+            fclose(file);
+
+            options.files[options.file_count++] = level_names[level - 1];
+        }
+    }
+
+    if (options.scaling > 0) {
+        int scaling_failures = run_scaling(&options);
+        SDL_Quit();
+        return scaling_failures ? 1 : 0;
+    }
+
+    FILE *solutions = NULL;
+    if (options.solutions_out) {
+        solutions = fopen(options.solutions_out, "wb");
+        if (!solutions) {
+            printf("Could not write %s\n", options.solutions_out);
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    int portfolio_wins[PORTFOLIO_STRATEGY_COUNT] = {0};
+
+    printf("%-28s %8s %8s %12s %12s %10s %14s %7s %10s\n", "level", "pushes", "moves", "expanded", "generated", "ms", "nodes/s", "table", "evicted");
+
+    for (int f = 0; f < options.file_count; f += 1)
+    {
+        char *filename = options.files[f];
+
+        Board board = {0};
+        if (!populate_board_from_file(&board, filename)) {
+            printf("%-28s could not load\n", filename);
+            failures += 1;
+            continue;
+        }
+
+        options.solver.on_solution = print_improvement;
+        options.solver.on_solution_data = filename;
+        Solver_Result result = solve_board(&board, &options.solver);
+        free_board(&board);
+
+        if (result.portfolio_winner >= 0 && result.portfolio_strategies) portfolio_wins[result.portfolio_winner] += 1;
+
+        double nodes_per_second = result.seconds > 0 ? result.nodes_expanded / result.seconds : 0;
+
+        if (!result.solved) {
+            printf("%-28s %8s %8s %12lld %12lld %10.1f %14.0f %6.1f%% %10lld  %s\n",
+                   filename, "-", "-", result.nodes_expanded, result.nodes_generated, result.seconds * 1000.0, nodes_per_second,
+                   result.table_load * 100.0, result.table.replacements,
+                   result.gave_up ? "gave up" : "UNSOLVABLE");
+            if (options.stats) print_stats(&result);
+            if (result.gave_up || !options.expect_unsolvable) failures += 1;
+            continue;
+        }
+
+        bool verified = verify_solution(filename, result.moves);
+
+        printf("%-28s %8d %8d %12lld %12lld %10.1f %14.0f %6.1f%% %10lld  %s\n",
+               filename, result.push_count, result.move_count, result.nodes_expanded, result.nodes_generated, result.seconds * 1000.0, nodes_per_second,
+               result.table_load * 100.0, result.table.replacements,
+               !verified ? "DOES NOT REPLAY" : options.expect_unsolvable ? "SOLVED, EXPECTED NO SOLUTION" : result.gave_up ? "ok, maybe not fewest" : "ok");
+        if (options.stats) print_stats(&result);
+
+        if (!verified || options.expect_unsolvable) failures += 1;
+
+        if (solutions) fprintf(solutions, "%s\r\n", result.moves);
+
+        free_solver_result(&result);
+    }
+
+    if (solutions) fclose(solutions);
+
+    if (options.solver.portfolio) {
+        printf("\nfirst to finish:");
+        for (int s = 0; s < PORTFOLIO_STRATEGY_COUNT; s += 1) printf(" %s %d", portfolio_names[s], portfolio_wins[s]);
+        printf("\n");
+    }
+
+    SDL_Quit();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,1326 @@
+//
+// Push-optimal solver.
+//
+// A* in push space: a state is the set of box cells plus the player's
+// reachable region, stored as the smallest cell index in that region, so
+// walking around without pushing never makes a new state. Every push costs
+// one. The lower bound is a minimum cost matching of boxes to goals (see
+// matching.c) over push distances with the other boxes ignored, computed
+// once per level by pulling boxes backwards from every goal and kept in a
+// small cache keyed by the level's walls and goals, or the pattern
+// databases (see pattern.c) when they say more.
+//
+// With bidirectional set it also searches back from the goals by pulls, see
+// bidirectional.c. With ida set it searches depth first in fixed memory
+// instead, see ida.c, and with external set breadth first on disk, see
+// external.c.
+//
+// The result is the full move list (walks and pushes) in w/a/s/d, the same
+// letters the replay files use.
+//
+// Seen positions go in a transposition table of fixed size, so a long
+// search stops forgetting duplicates instead of running out of memory.
+// Nodes keep their boxes packed, see state.c, and the player's region is
+// flooded on bitboards, see bitboard.c.
+//
+
+#include "transposition.c"
+
+#define SOLVER_WALL 1
+#define SOLVER_GOAL 2
+
+#define SOLVER_INFINITY 0x3fffffff
+
+#include "bitboard.c"
+#include "deadlock.c"
+#include "macro.c"
+#include "matching.c"
+#include "pattern.c"
+#include "state.c"
+#include "symmetry.c"
+
+#define DISTANCE_CACHE_SIZE 4
+
+typedef struct {
+    unsigned long long level_hash;
+    int w;
+    int cell_count;
+    unsigned char *cells;
+
+    int *distances;
+    int *nearest_goal;
+
+    // Levels using the entry right now. Only unused entries are ever dropped.
+    int users;
+    unsigned long long last_used;
+} Distance_Cache_Entry;
+
+typedef struct {
+    int w, h;
+    int cell_count;
+    unsigned char *cells;
+
+    int *goals;
+    int goal_count;
+
+    int box_count;
+    int *start_boxes;
+    int start_player;
+
+    // Indexed by Direction.
+    int offsets[4];
+
+    // distances[cell * goal_count + goal]: pushes to get a box from cell onto that goal, other boxes ignored.
+    // A box's row is contiguous, which is the order the matching reads it in.
+    int *distances;
+    // Smallest entry of `distances` over all goals, per cell.
+    int *nearest_goal;
+
+    // Hash of the walls and goals, and the cache entry the tables above belong to, NULL if they are the level's own.
+    unsigned long long level_hash;
+    Distance_Cache_Entry *distance_entry;
+
+    // Zobrist keys per cell, the same ones Board uses, so a solver hash of a position matches board->hash
+    // when the player stands on the smallest cell of its region.
+    unsigned long long *box_keys;
+    unsigned long long *player_keys;
+
+    Deadlock_Level deadlock;
+    Macro_Level macros;
+    Pattern_Database patterns;
+    State_Encoding encoding;
+    Bitboard_Level bitboard;
+    Symmetry_Level symmetry;
+} Solver_Level;
+
+#define SOLVER_DEFAULT_TABLE_MB 64
+#define SOLVER_DEFAULT_PATTERN_BOXES 2
+
+typedef struct {
+    long long max_nodes;
+    double time_limit;
+
+    // Memory cap for the transposition table, or the sort buffer of the external search, 0 for the default.
+    long long table_megabytes;
+
+    // More than one searches in parallel, see parallel.c.
+    int threads;
+
+    Deadlock_Options deadlocks;
+
+    // Goals per pattern database group, 0 for the default, -1 for no pattern databases.
+    int pattern_boxes;
+    // Where pattern databases are cached between runs, NULL for the working directory.
+    char *pattern_directory;
+
+    // Search back from the goals by pulls as well, see bidirectional.c. Single threaded.
+    bool bidirectional;
+
+    // Depth first under a rising bound in fixed memory, see ida.c. The checkpoint file, if
+    // any, keeps the bound between runs.
+    bool ida;
+    char *checkpoint_file;
+
+    // Breadth first with the layers on disk, see external.c, in this directory or the working one.
+    bool external;
+    char *external_directory;
+
+    // Tunnel and goal room macros, see macro.c. Solutions may take more pushes. The bidirectional
+    // and external searches leave them out.
+    bool macros;
+
+    // Search the images of a symmetric level's positions apart, see symmetry.c. The bidirectional
+    // and external searches always do.
+    bool ignore_symmetry;
+
+    // A first solution soon and better ones until max_nodes or time_limit, see anytime.c. Each
+    // better one goes to on_solution, if set, with its moves only good for the call.
+    bool anytime;
+    void (*on_solution)(void *data, char *moves, int push_count, double seconds);
+    void *on_solution_data;
+
+    // The A*, anytime, bidirectional and IDA* searches at once on threads, the first to finish
+    // stopping the others, see portfolio.c.
+    bool portfolio;
+
+    // Set by another thread to make the search give up as if out of time. Only the searches a
+    // portfolio runs look at it.
+    SDL_atomic_t *cancel;
+} Solver_Options;
+
+typedef struct {
+    bool solved;
+    // Stopped by max_nodes or time_limit. An anytime search can have a solution as well, which
+    // then may not have the fewest pushes.
+    bool gave_up;
+
+    char *moves;
+    int move_count;
+    int push_count;
+
+    long long nodes_expanded;
+    long long nodes_generated;
+    double seconds;
+
+    // Of nodes_expanded, the ones a bidirectional search expanded by pulls.
+    long long backward_expanded;
+
+    // IDA* bounds tried, the last one, and the one a checkpoint started it from, 0 if none did.
+    int iterations;
+    int final_bound;
+    int resumed_bound;
+
+    // Anytime search: weighted searches run, solutions they found, and the last weight, in hundredths.
+    int anytime_runs;
+    int anytime_solutions;
+    int anytime_weight;
+
+    // Portfolio search: how many strategies raced, and the one that finished first, see portfolio.c.
+    int portfolio_strategies;
+    int portfolio_winner;
+
+    // External search: layers finished, positions seen, bytes written, and the layer it picked up from.
+    int external_layers;
+    long long external_positions;
+    long long external_bytes;
+    int resumed_layer;
+
+    Transposition_Stats table;
+    long long table_bytes;
+    double table_load;
+
+    Deadlock_Stats deadlocks;
+
+    // Player regions found from the one before a push or pull, the moves of those that cut a part of
+    // the region off, and regions filled from scratch, see bitboard.c.
+    long long reach_updates;
+    long long reach_splits;
+    long long reach_fills;
+
+    // Cells a box can stand on, and bytes per position for the boxes, see state.c.
+    int live_cells;
+    int state_bytes;
+
+    // Symmetries of the level the search used, the identity among them, see symmetry.c.
+    int symmetries;
+
+    // Cells and rooms macros were found for, and pushes they carried on, see macro.c.
+    int tunnel_cells;
+    int goal_rooms;
+    long long tunnel_runs;
+    long long room_fills;
+
+    int pattern_groups;
+    int pattern_boxes;
+    long long pattern_bytes;
+    double pattern_seconds;
+    bool patterns_cached;
+} Solver_Result;
+
+typedef struct {
+    unsigned long long box_hash;
+
+    int parent;
+    // Which worker's store `parent` is in, when searching in parallel.
+    int parent_worker;
+    int player;
+    int g;
+    int f;
+
+    // The push that made this node: box cell before the push and its direction, and the macro
+    // that carried it on, see carry_macro. They are in the parent's image of its position.
+    int box_from;
+    int direction;
+    int macro;
+
+    // Which image of the position the node holds: the symmetry that takes the real one there.
+    int symmetry;
+} Solver_Node;
+
+typedef struct {
+    int f;
+    int g;
+    int node;
+} Heap_Entry;
+
+typedef struct {
+    Solver_Level *level;
+
+    // node_states holds each node's boxes in the level's encoding, see state.c.
+    Solver_Node *nodes;
+    unsigned char *node_states;
+    int node_count;
+    int node_capacity;
+
+    // Shared between workers when searching in parallel.
+    Transposition_Table *table;
+    Transposition_Stats table_stats;
+
+    // The caller's options, with everything off when the level has spare boxes.
+    Deadlock_Options deadlock_options;
+    Deadlock_Scratch deadlock;
+    Deadlock_Stats deadlock_stats;
+
+    Heap_Entry *heap;
+    int heap_count;
+    int heap_capacity;
+
+    bool macros;
+    long long tunnel_runs;
+    long long room_fills;
+
+    // Whether positions go in as their canonical image, and the symmetry the start went in with.
+    bool symmetric;
+    int start_symmetry;
+
+    // The player's region from the last flood_player, see bitboard.c, and the one generate_pushes
+    // or generate_pulls last worked from, which the children's regions start from.
+    Bitboard_Scratch reach;
+    Bitboard_Word *parent_reach;
+    int *queue;
+    bool *box_here;
+
+    // The matching of the node being expanded, and a copy each child moves one box in.
+    Matching matching;
+    Matching child_matching;
+    Pattern_Scratch patterns;
+
+    // Expansion scratch.
+    int *push_box;
+    int *push_direction;
+    int *child_boxes;
+    unsigned char *state;
+} Solver;
+
+char direction_letter(int direction)
+{
+    switch (direction)
+    {
+        case NORTH: return 'w';
+        case WEST:  return 'a';
+        case SOUTH: return 's';
+        case EAST:  return 'd';
+        default:    return '?';
+    }
+}
+
+double solver_seconds(void)
+{
+    return (double)SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+}
+
+// Whether another thread asked the search to stop, see Solver_Options.cancel.
+bool solver_cancelled(Solver_Options *options)
+{
+    return options->cancel && SDL_AtomicGet(options->cancel);
+}
+
+//
+// Level
+//
+
+void compute_push_distances(Solver_Level *level)
+{
+    int n = level->cell_count;
+    int goal_count = level->goal_count;
+    level->distances = malloc(sizeof(int) * (size_t)n * (goal_count > 0 ? goal_count : 1));
+    level->nearest_goal = malloc(sizeof(int) * n);
+    int *queue = malloc(sizeof(int) * n);
+
+    for (size_t c = 0; c < (size_t)n * goal_count; c += 1) level->distances[c] = SOLVER_INFINITY;
+    for (int c = 0; c < n; c += 1) level->nearest_goal[c] = SOLVER_INFINITY;
+
+    for (int g = 0; g < goal_count; g += 1)
+    {
+        int *distance = &level->distances[g];
+
+        int head = 0, tail = 0;
+        distance[(size_t)level->goals[g] * goal_count] = 0;
+        queue[tail++] = level->goals[g];
+
+        // Pull backwards: a box at `cell` came from cell - d if the player could stand at cell - 2d.
+        while (head < tail)
+        {
+            int cell = queue[head++];
+            int pulls = distance[(size_t)cell * goal_count] + 1;
+
+            for (int d = 0; d < 4; d += 1)
+            {
+                int from = cell - level->offsets[d];
+                int player = from - level->offsets[d];
+
+                if (level->cells[from] & SOLVER_WALL) continue;
+                if (level->cells[player] & SOLVER_WALL) continue;
+                if (distance[(size_t)from * goal_count] != SOLVER_INFINITY) continue;
+
+                distance[(size_t)from * goal_count] = pulls;
+                if (pulls < level->nearest_goal[from]) level->nearest_goal[from] = pulls;
+                queue[tail++] = from;
+            }
+        }
+
+        level->nearest_goal[level->goals[g]] = 0;
+    }
+
+    free(queue);
+}
+
+//
+// Distance cache
+//
+
+// Push distances only depend on the walls and goals, so a level solved again (a scaling run, a
+// retry with other options, a hint in the same level) takes them from here.
+Distance_Cache_Entry distance_cache[DISTANCE_CACHE_SIZE];
+unsigned long long distance_cache_clock;
+
+unsigned long long hash_level_cells(unsigned char *cells, int cell_count, int w)
+{
+    // FNV-1a, the width first so two shapes with the same cells in a row do not collide.
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    hash = (hash ^ (unsigned long long)w) * 0x100000001b3ULL;
+
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        hash = (hash ^ cells[c]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+// Points the level at cached distance tables, computing and caching them on a miss.
+void acquire_push_distances(Solver_Level *level)
+{
+    level->level_hash = hash_level_cells(level->cells, level->cell_count, level->w);
+    distance_cache_clock += 1;
+
+    for (int e = 0; e < DISTANCE_CACHE_SIZE; e += 1)
+    {
+        Distance_Cache_Entry *entry = &distance_cache[e];
+        if (!entry->cells || entry->level_hash != level->level_hash) continue;
+
+        // The hash only picks the entry, the cells decide.
+        if (entry->w != level->w || entry->cell_count != level->cell_count) continue;
+        if (memcmp(entry->cells, level->cells, level->cell_count) != 0) continue;
+
+        entry->users += 1;
+        entry->last_used = distance_cache_clock;
+        level->distance_entry = entry;
+        level->distances = entry->distances;
+        level->nearest_goal = entry->nearest_goal;
+        return;
+    }
+
+    compute_push_distances(level);
+
+    // Empty entries have never been used, so they go first.
+    Distance_Cache_Entry *victim = NULL;
+    for (int e = 0; e < DISTANCE_CACHE_SIZE; e += 1)
+    {
+        Distance_Cache_Entry *entry = &distance_cache[e];
+        if (entry->users > 0) continue;
+        if (!victim || entry->last_used < victim->last_used) victim = entry;
+    }
+
+    // Every entry is in use, so this level keeps its tables to itself.
+    if (!victim) return;
+
+    free(victim->cells);
+    free(victim->distances);
+    free(victim->nearest_goal);
+
+    victim->level_hash = level->level_hash;
+    victim->w = level->w;
+    victim->cell_count = level->cell_count;
+    victim->cells = malloc(level->cell_count);
+    memcpy(victim->cells, level->cells, level->cell_count);
+    victim->distances = level->distances;
+    victim->nearest_goal = level->nearest_goal;
+    victim->users = 1;
+    victim->last_used = distance_cache_clock;
+
+    level->distance_entry = victim;
+}
+
+void release_push_distances(Solver_Level *level)
+{
+    if (level->distance_entry) {
+        level->distance_entry->users -= 1;
+    } else {
+        free(level->distances);
+        free(level->nearest_goal);
+    }
+
+    level->distance_entry = NULL;
+    level->distances = NULL;
+    level->nearest_goal = NULL;
+}
+
+// Copies the board into flat arrays with a ring of wall around it, so neighbours never need bounds checks.
+bool make_solver_level(Board *board, Solver_Level *level)
+{
+    memset(level, 0, sizeof(*level));
+
+    level->w = board->w + 2;
+    level->h = board->h + 2;
+    level->cell_count = level->w * level->h;
+    level->cells = malloc(level->cell_count);
+
+    level->offsets[NORTH] = -level->w;
+    level->offsets[SOUTH] = level->w;
+    level->offsets[WEST] = -1;
+    level->offsets[EAST] = 1;
+
+    int box_capacity = 16;
+    int goal_capacity = 16;
+    level->start_boxes = malloc(sizeof(int) * box_capacity);
+    level->goals = malloc(sizeof(int) * goal_capacity);
+
+    Board_Cursor cursor = make_cursor(board);
+
+    for (int i = 0; i < level->h; i += 1)
+    {
+        for (int j = 0; j < level->w; j += 1)
+        {
+            int cell = i * level->w + j;
+            Tile tile = read_tile(&cursor, i - 1, j - 1);
+
+            level->cells[cell] = 0;
+            if (tile_type(tile) == WALL) level->cells[cell] |= SOLVER_WALL;
+
+            if (tile_type(tile) == GOAL) {
+                level->cells[cell] |= SOLVER_GOAL;
+
+                if (level->goal_count == goal_capacity) {
+                    goal_capacity *= 2;
+                    level->goals = realloc(level->goals, sizeof(int) * goal_capacity);
+                }
+                level->goals[level->goal_count++] = cell;
+            }
+
+            if (tile_has_box(tile)) {
+                if (level->box_count == box_capacity) {
+                    box_capacity *= 2;
+                    level->start_boxes = realloc(level->start_boxes, sizeof(int) * box_capacity);
+                }
+                level->start_boxes[level->box_count++] = cell;
+            }
+        }
+    }
+
+    level->start_player = (board->player_i + 1) * level->w + (board->player_j + 1);
+
+    level->box_keys = malloc(sizeof(unsigned long long) * level->cell_count);
+    level->player_keys = malloc(sizeof(unsigned long long) * level->cell_count);
+
+    for (int cell = 0; cell < level->cell_count; cell += 1)
+    {
+        level->box_keys[cell] = zobrist_key(cell / level->w - 1, cell % level->w - 1, ZOBRIST_BOX);
+        level->player_keys[cell] = zobrist_key(cell / level->w - 1, cell % level->w - 1, ZOBRIST_PLAYER);
+    }
+
+    if (level->box_count < level->goal_count) return false;
+
+    acquire_push_distances(level);
+    build_deadlock_level(&level->deadlock, level->cells, level->w, level->cell_count, level->offsets, level->nearest_goal);
+    build_state_encoding(&level->encoding, level->cells, level->cell_count, level->offsets, level->start_player,
+                         level->start_boxes, level->box_count, level->nearest_goal, level->box_count > level->goal_count);
+    build_bitboard_level(&level->bitboard, level->cells, level->w, level->h);
+    build_symmetry_level(&level->symmetry, level->cells, level->w, level->h, level->offsets, level->encoding.live_index);
+    return true;
+}
+
+void free_solver_level(Solver_Level *level)
+{
+    free(level->cells);
+    free(level->goals);
+    free(level->start_boxes);
+    release_push_distances(level);
+    free(level->box_keys);
+    free(level->player_keys);
+    free_deadlock_level(&level->deadlock);
+    free_pattern_database(&level->patterns);
+    free_state_encoding(&level->encoding);
+    free_bitboard_level(&level->bitboard);
+    free_macro_level(&level->macros);
+    free_symmetry_level(&level->symmetry);
+    memset(level, 0, sizeof(*level));
+}
+
+// Maps the level's pattern databases in from the cache, or builds them and writes them there.
+void prepare_patterns(Solver_Level *level, Solver_Options *options)
+{
+    Pattern_Database *database = &level->patterns;
+
+    int group_size = options->pattern_boxes ? options->pattern_boxes : SOLVER_DEFAULT_PATTERN_BOXES;
+    if (group_size > PATTERN_MAX_BOXES) group_size = PATTERN_MAX_BOXES;
+    if (group_size < 2 || level->goal_count < 2) return;
+
+    find_live_cells(database, level->nearest_goal, level->cell_count);
+
+    // One goal per group is only the push distance, which the matching already counts.
+    while (group_size > 1 && choose(database->live_count, group_size) > PATTERN_MAX_ENTRIES) group_size -= 1;
+    if (group_size < 2) return;
+
+    database->group_size = group_size;
+
+    char filename[1024];
+    pattern_filename(filename, sizeof(filename), options->pattern_directory, level->level_hash, group_size);
+
+    if (load_pattern_database(database, filename, level->level_hash, level->cells, level->w, level->cell_count)) return;
+
+    int threads = options->threads > 0 ? options->threads : SDL_GetCPUCount();
+    build_pattern_database(database, level->cells, level->offsets, level->goals, level->goal_count, level->distances, threads);
+
+    // Not being able to write the cache only costs the next run a rebuild.
+    save_pattern_database(database, filename, level->level_hash, level->cells, level->w, level->cell_count);
+}
+
+bool is_solved_position(Solver_Level *level, int *boxes)
+{
+    int on_goal = 0;
+    for (int b = 0; b < level->box_count; b += 1)
+    {
+        if (level->cells[boxes[b]] & SOLVER_GOAL) on_goal += 1;
+    }
+
+    return on_goal == level->goal_count;
+}
+
+//
+// Search bookkeeping
+//
+
+unsigned long long hash_boxes(Solver_Level *level, int *boxes)
+{
+    unsigned long long hash = 0;
+    for (int b = 0; b < level->box_count; b += 1) hash ^= level->box_keys[boxes[b]];
+    return hash;
+}
+
+unsigned long long node_hash(Solver *solver, int node)
+{
+    return solver->nodes[node].box_hash ^ solver->level->player_keys[solver->nodes[node].player];
+}
+
+unsigned char *state_of(Solver *solver, int node)
+{
+    return &solver->node_states[(size_t)node * solver->level->encoding.state_bytes];
+}
+
+// Unpacks the node's boxes, sorted, into `boxes`.
+void boxes_of(Solver *solver, int node, int *boxes)
+{
+    decode_boxes(&solver->level->encoding, state_of(solver, node), solver->level->box_count, boxes);
+}
+
+bool same_position(Solver *solver, int node, int *boxes, int player)
+{
+    if (solver->nodes[node].player != player) return false;
+
+    State_Encoding *encoding = &solver->level->encoding;
+    encode_boxes(encoding, boxes, solver->level->box_count, solver->state);
+    return memcmp(state_of(solver, node), solver->state, encoding->state_bytes) == 0;
+}
+
+// Returns the node already holding this position and its g, or -1 if the table does not remember one.
+int find_position(Solver *solver, unsigned long long box_hash, int *boxes, int player, int *g)
+{
+    unsigned int node;
+    if (!transposition_lookup(solver->table, box_hash ^ solver->level->player_keys[player], g, &node)) return -1;
+
+    // The table only knows hashes, so make sure it is really the same position.
+    if ((int)node >= solver->node_count) return -1;
+    if (solver->nodes[node].box_hash != box_hash || !same_position(solver, node, boxes, player)) return -1;
+
+    return (int)node;
+}
+
+int add_node(Solver *solver, unsigned long long box_hash, int *boxes, int player)
+{
+    if (solver->node_count == solver->node_capacity) {
+        solver->node_capacity = solver->node_capacity ? solver->node_capacity * 2 : 1024;
+        solver->nodes = realloc(solver->nodes, sizeof(Solver_Node) * solver->node_capacity);
+        solver->node_states = realloc(solver->node_states, (size_t)solver->node_capacity * solver->level->encoding.state_bytes);
+    }
+
+    int node = solver->node_count++;
+    encode_boxes(&solver->level->encoding, boxes, solver->level->box_count, state_of(solver, node));
+    solver->nodes[node].player = player;
+    solver->nodes[node].box_hash = box_hash;
+    solver->nodes[node].parent_worker = 0;
+    solver->nodes[node].macro = 0;
+    solver->nodes[node].symmetry = 0;
+    return node;
+}
+
+bool heap_less(Heap_Entry *a, Heap_Entry *b)
+{
+    // Deeper first among equal f, it reaches the goal sooner.
+    if (a->f != b->f) return a->f < b->f;
+    return a->g > b->g;
+}
+
+void heap_push(Solver *solver, int node)
+{
+    if (solver->heap_count == solver->heap_capacity) {
+        solver->heap_capacity = solver->heap_capacity ? solver->heap_capacity * 2 : 1024;
+        solver->heap = realloc(solver->heap, sizeof(Heap_Entry) * solver->heap_capacity);
+    }
+
+    Heap_Entry *heap = solver->heap;
+    int i = solver->heap_count++;
+    heap[i].f = solver->nodes[node].f;
+    heap[i].g = solver->nodes[node].g;
+    heap[i].node = node;
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!heap_less(&heap[i], &heap[parent])) break;
+
+        Heap_Entry swap = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = swap;
+        i = parent;
+    }
+}
+
+Heap_Entry heap_pop(Solver *solver)
+{
+    Heap_Entry *heap = solver->heap;
+    Heap_Entry top = heap[0];
+    solver->heap_count -= 1;
+    heap[0] = heap[solver->heap_count];
+
+    int i = 0;
+    while (true)
+    {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int best = i;
+
+        if (left < solver->heap_count && heap_less(&heap[left], &heap[best])) best = left;
+        if (right < solver->heap_count && heap_less(&heap[right], &heap[best])) best = right;
+        if (best == i) break;
+
+        Heap_Entry swap = heap[i];
+        heap[i] = heap[best];
+        heap[best] = swap;
+        i = best;
+    }
+
+    return top;
+}
+
+//
+// Moves
+//
+
+// Finds every cell the player can walk to and returns the smallest one, which names the region.
+int flood_player(Solver *solver, int *boxes, int player)
+{
+    Solver_Level *level = solver->level;
+    return flood_bitboard(&level->bitboard, &solver->reach, boxes, level->box_count, player);
+}
+
+// The same after one push or pull made from inside the region `before`, found from that region
+// instead of filled again where it can be. `boxes` are the boxes after the move, which went from
+// `from` to `to` and left the player on `player`.
+int flood_player_after_move(Solver *solver, Bitboard_Word *before, int *boxes, int from, int to, int player)
+{
+    Solver_Level *level = solver->level;
+    return flood_bitboard_after_move(&level->bitboard, &solver->reach, before, boxes, level->box_count, from, to, player);
+}
+
+// Where pushing box b of `boxes` in direction d leaves the box and the player, carried on by a
+// macro when they are on. Returns the macro for the node, and the pushes it makes in `pushes`.
+int carry_push(Solver *solver, int *boxes, int b, int d, int *to, int *player, int *pushes)
+{
+    Solver_Level *level = solver->level;
+    int from = boxes[b];
+
+    if (!solver->macros) {
+        *to = from + level->offsets[d];
+        *player = from;
+        *pushes = 1;
+        return 0;
+    }
+
+    int macro = carry_macro(&level->macros, level->offsets, boxes, level->box_count, from, d, to, player, pushes);
+    if (macro > 0) solver->tunnel_runs += 1;
+    if (macro < 0) solver->room_fills += 1;
+    return macro;
+}
+
+// The player's region after a push carry_push made from inside the region `before`. Only a
+// single push is a move flood_player_after_move can follow, a macro fills it again.
+int flood_player_after_push(Solver *solver, Bitboard_Word *before, int *boxes, int from, int to, int player, int macro)
+{
+    if (macro) return flood_player(solver, boxes, player);
+    return flood_player_after_move(solver, before, boxes, from, to, player);
+}
+
+// The symmetry that takes a position to its canonical image, the one with the smallest key, see
+// symmetry.c. Leaves the image's box hash and player in `box_hash` and `player`. The player's
+// region has to be the one of the last flood_player.
+int canonical_symmetry(Solver *solver, int *boxes, unsigned long long *box_hash, int *player)
+{
+    if (!solver->symmetric) return 0;
+
+    Solver_Level *level = solver->level;
+    Symmetry_Level *symmetry = &level->symmetry;
+
+    int best = 0;
+    unsigned long long best_key = *box_hash ^ level->player_keys[*player];
+
+    for (int s = 1; s < symmetry->count; s += 1)
+    {
+        unsigned long long hash = 0;
+        for (int b = 0; b < level->box_count; b += 1) hash ^= level->box_keys[symmetry->map[s][boxes[b]]];
+
+        int image_player = symmetric_smallest_cell(&level->bitboard, solver->reach.reach, symmetry->kind[s]);
+        unsigned long long key = hash ^ level->player_keys[image_player];
+
+        if (key < best_key) {
+            best = s;
+            best_key = key;
+            *box_hash = hash;
+            *player = image_player;
+        }
+    }
+
+    return best;
+}
+
+// The key the table knows a position by, the same for all its images. The player's region has to
+// be the one of the last flood_player.
+unsigned long long position_key(Solver *solver, int *boxes, unsigned long long box_hash, int player)
+{
+    canonical_symmetry(solver, boxes, &box_hash, &player);
+    return box_hash ^ solver->level->player_keys[player];
+}
+
+// Whether the player can walk to `cell` in the region of the last flood_player.
+bool player_reaches(Solver *solver, int cell)
+{
+    return bitboard_test(&solver->level->bitboard, solver->reach.reach, cell);
+}
+
+int compare_ints(const void *a, const void *b)
+{
+    int x = *(int *)a;
+    int y = *(int *)b;
+    return (x > y) - (x < y);
+}
+
+// Keeps the box list sorted after one box moved, so equal positions compare equal.
+void resort_box(int *boxes, int count, int moved)
+{
+    while (moved > 0 && boxes[moved - 1] > boxes[moved])
+    {
+        int swap = boxes[moved];
+        boxes[moved] = boxes[moved - 1];
+        boxes[moved - 1] = swap;
+        moved -= 1;
+    }
+
+    while (moved < count - 1 && boxes[moved + 1] < boxes[moved])
+    {
+        int swap = boxes[moved];
+        boxes[moved] = boxes[moved + 1];
+        boxes[moved + 1] = swap;
+        moved += 1;
+    }
+}
+
+// Moves the boxes to their image under a symmetry, sorted again.
+void turn_boxes(Solver_Level *level, int symmetry, int *boxes)
+{
+    if (symmetry == 0) return;
+
+    for (int b = 0; b < level->box_count; b += 1) boxes[b] = level->symmetry.map[symmetry][boxes[b]];
+    qsort(boxes, level->box_count, sizeof(int), compare_ints);
+}
+
+// Walks the player from `from` to `to` around the boxes, appending the letters. Breadth first, so shortest.
+int append_walk(Solver *solver, int *boxes, int from, int to, char *out)
+{
+    Solver_Level *level = solver->level;
+    if (from == to) return 0;
+
+    int *came_from = malloc(sizeof(int) * level->cell_count);
+    for (int c = 0; c < level->cell_count; c += 1) came_from[c] = -1;
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = true;
+
+    int head = 0, tail = 0;
+    solver->queue[tail++] = from;
+    came_from[from] = from;
+
+    while (head < tail && came_from[to] == -1)
+    {
+        int cell = solver->queue[head++];
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int next = cell + level->offsets[d];
+            if (came_from[next] != -1) continue;
+            if ((level->cells[next] & SOLVER_WALL) || solver->box_here[next]) continue;
+
+            came_from[next] = cell;
+            solver->queue[tail++] = next;
+        }
+    }
+
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = false;
+
+    int length = 0;
+    for (int cell = to; cell != from; cell = came_from[cell]) length += 1;
+
+    int at = length;
+    for (int cell = to; cell != from; cell = came_from[cell])
+    {
+        int step = cell - came_from[cell];
+        int direction = NORTH;
+        for (int d = 0; d < 4; d += 1) if (level->offsets[d] == step) direction = d;
+
+        at -= 1;
+        if (out) out[at] = direction_letter(direction);
+    }
+
+    free(came_from);
+    return length;
+}
+
+// Turns a list of pushes from the start into moves, walking the player between pushes.
+void build_moves(Solver *solver, Solver_Node **pushes, int push_count, Solver_Result *result)
+{
+    Solver_Level *level = solver->level;
+
+    int *boxes = malloc(sizeof(int) * (level->box_count + 1));
+    memcpy(boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(boxes, level->box_count, sizeof(int), compare_ints);
+    int player = level->start_player;
+
+    // Macros turned back into the single pushes they stand for.
+    int single_count = 0;
+    for (int p = 0; p < push_count; p += 1)
+    {
+        single_count += expand_macro(&level->macros, level->offsets, pushes[p]->macro, pushes[p]->box_from, pushes[p]->direction, NULL, NULL);
+    }
+
+    // Each is in the image its parent holds, and turned back into the real level.
+    Symmetry_Level *symmetry = &level->symmetry;
+    int undo = symmetry->inverse[solver->start_symmetry];
+
+    int *single_from = malloc(sizeof(int) * (single_count + 1));
+    int *single_direction = malloc(sizeof(int) * (single_count + 1));
+    int at = 0;
+    for (int p = 0; p < push_count; p += 1)
+    {
+        int count = expand_macro(&level->macros, level->offsets, pushes[p]->macro, pushes[p]->box_from, pushes[p]->direction,
+                                 &single_from[at], &single_direction[at]);
+
+        for (int s = at; s < at + count; s += 1)
+        {
+            single_from[s] = symmetry->map[undo][single_from[s]];
+            single_direction[s] = symmetry->directions[undo][single_direction[s]];
+        }
+
+        at += count;
+        undo = symmetry->inverse[pushes[p]->symmetry];
+    }
+
+    // Walks are at most one cell per cell of the level.
+    int capacity = 1024;
+    char *moves = malloc(capacity);
+    int length = 0;
+
+    for (int p = 0; p < single_count; p += 1)
+    {
+        int box_from = single_from[p];
+        int direction = single_direction[p];
+        int offset = level->offsets[direction];
+        int stand = box_from - offset;
+
+        if (length + level->cell_count + 2 > capacity) {
+            capacity = (length + level->cell_count + 2) * 2;
+            moves = realloc(moves, capacity);
+        }
+
+        length += append_walk(solver, boxes, player, stand, &moves[length]);
+        moves[length++] = direction_letter(direction);
+
+        for (int b = 0; b < level->box_count; b += 1)
+        {
+            if (boxes[b] == box_from) {
+                boxes[b] = box_from + offset;
+                resort_box(boxes, level->box_count, b);
+                break;
+            }
+        }
+
+        player = box_from;
+    }
+
+    moves[length] = 0;
+
+    result->moves = moves;
+    result->move_count = length;
+    result->push_count = single_count;
+
+    free(boxes);
+    free(single_from);
+    free(single_direction);
+}
+
+void build_solution(Solver *solver, int node, Solver_Result *result)
+{
+    int push_count = 0;
+    for (int n = node; solver->nodes[n].parent != -1; n = solver->nodes[n].parent) push_count += 1;
+
+    Solver_Node **pushes = malloc(sizeof(Solver_Node *) * (push_count + 1));
+    int at = push_count;
+    for (int n = node; solver->nodes[n].parent != -1; n = solver->nodes[n].parent) pushes[--at] = &solver->nodes[n];
+
+    build_moves(solver, pushes, push_count, result);
+    free(pushes);
+}
+
+void free_solver(Solver *solver)
+{
+    free(solver->nodes);
+    free(solver->node_states);
+    free(solver->heap);
+    free_bitboard_scratch(&solver->reach);
+    free(solver->parent_reach);
+    free(solver->queue);
+    free(solver->box_here);
+    free(solver->push_box);
+    free(solver->push_direction);
+    free(solver->child_boxes);
+    free(solver->state);
+    free_deadlock_scratch(&solver->deadlock);
+    free_matching(&solver->matching);
+    free_matching(&solver->child_matching);
+    free_pattern_scratch(&solver->patterns);
+}
+
+bool push_deadlocked_child(Solver *solver, int *child_boxes, int to)
+{
+    Solver_Level *level = solver->level;
+
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[child_boxes[b]] = true;
+    bool deadlocked = push_deadlocked(&level->deadlock, &solver->deadlock, &solver->deadlock_options, &solver->deadlock_stats, solver->box_here, to);
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[child_boxes[b]] = false;
+
+    return deadlocked;
+}
+
+// Admissible: every goal needs its own box, and no box gets there in fewer pushes than its distance.
+// Keeps the matching and the pattern lookups, so the children of `boxes` can be bounded with child_lower_bound.
+int lower_bound(Solver *solver, int *boxes)
+{
+    Solver_Level *level = solver->level;
+
+    int matched = solve_matching(&solver->matching, boxes);
+    int patterns = pattern_bound(&level->patterns, &solver->patterns, boxes, level->box_count);
+    return patterns > matched ? patterns : matched;
+}
+
+// The bound once box b of `boxes`, the last ones given to lower_bound, is pushed to `to`.
+int child_lower_bound(Solver *solver, int *boxes, int b, int to)
+{
+    Solver_Level *level = solver->level;
+
+    copy_matching(&solver->child_matching, &solver->matching);
+    int matched = move_matching_box(&solver->child_matching, b, to);
+    if (matched == SOLVER_INFINITY) return matched;
+
+    int patterns = child_pattern_bound(&level->patterns, &solver->patterns, boxes, level->box_count, b, to);
+    return patterns > matched ? patterns : matched;
+}
+
+// Lists the pushes the player can make from `node`'s region into the solver's push scratch,
+// or only the ones into a PI-corral when there is one.
+int generate_pushes(Solver *solver, int *boxes, int player)
+{
+    Solver_Level *level = solver->level;
+    int push_count = 0;
+
+    flood_player(solver, boxes, player);
+    copy_bitboard(&level->bitboard, solver->parent_reach, solver->reach.reach);
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = true;
+
+    if (deadlock_enabled(&solver->deadlock_options, DEADLOCK_CORRAL)) {
+        push_count = find_pi_corral(&level->deadlock, &solver->deadlock, &solver->deadlock_options, &solver->deadlock_stats,
+                                    solver->box_here, boxes, level->box_count, &level->bitboard, solver->reach.reach);
+
+        if (push_count > 0) {
+            memcpy(solver->push_box, solver->deadlock.corral_box, sizeof(int) * push_count);
+            memcpy(solver->push_direction, solver->deadlock.corral_direction, sizeof(int) * push_count);
+            for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = false;
+            return push_count;
+        }
+    }
+
+    for (int b = 0; b < level->box_count; b += 1)
+    {
+        for (int d = 0; d < 4; d += 1)
+        {
+            int offset = level->offsets[d];
+            int stand = boxes[b] - offset;
+            int to = boxes[b] + offset;
+
+            if (!player_reaches(solver, stand)) continue;
+            if ((level->cells[to] & SOLVER_WALL) || solver->box_here[to]) continue;
+
+            solver->push_box[push_count] = b;
+            solver->push_direction[push_count] = d;
+            push_count += 1;
+        }
+    }
+
+    for (int b = 0; b < level->box_count; b += 1) solver->box_here[boxes[b]] = false;
+
+    return push_count;
+}
+
+void init_solver(Solver *solver, Solver_Level *level, Transposition_Table *table, Solver_Options *options)
+{
+    memset(solver, 0, sizeof(*solver));
+    solver->level = level;
+    solver->table = table;
+    solver->deadlock_options = options->deadlocks;
+    solver->macros = options->macros;
+    solver->symmetric = level->symmetry.count > 1 && !options->ignore_symmetry;
+
+    // Every check assumes each box has to end on a goal. With more boxes than goals some never
+    // do, and a box stuck off goal is not a lost level.
+    if (level->box_count > level->goal_count) solver->deadlock_options.disabled = (1 << DEADLOCK_KIND_COUNT) - 1;
+
+    init_deadlock_scratch(&solver->deadlock, level->cell_count, level->box_count);
+    init_matching(&solver->matching, level->box_count, level->distances, level->goal_count);
+    init_matching(&solver->child_matching, level->box_count, level->distances, level->goal_count);
+    init_pattern_scratch(&solver->patterns, &level->patterns, level->box_count);
+    init_bitboard_scratch(&solver->reach, &level->bitboard);
+    solver->parent_reach = make_bitboard(&level->bitboard);
+    solver->queue = malloc(sizeof(int) * level->cell_count);
+    solver->box_here = calloc(level->cell_count, sizeof(bool));
+    solver->push_box = malloc(sizeof(int) * 4 * (level->box_count + 1));
+    solver->push_direction = malloc(sizeof(int) * 4 * (level->box_count + 1));
+    solver->child_boxes = malloc(sizeof(int) * (level->box_count + 1));
+    solver->state = malloc(level->encoding.state_bytes);
+}
+
+bool init_solver_table(Transposition_Table *table, Solver_Options *options)
+{
+    long long table_megabytes = options->table_megabytes > 0 ? options->table_megabytes : SOLVER_DEFAULT_TABLE_MB;
+    return init_transposition_table(table, table_megabytes << 20);
+}
+
+// f of weighted A*, the weight in hundredths. At 100 it is plain A*.
+int weighted_f(int g, int h, int weight)
+{
+    if (h >= SOLVER_INFINITY) return SOLVER_INFINITY;
+    return g + (int)((long long)h * weight / 100);
+}
+
+// A* with h weighted, and children that can not come in under `bound` pushes cut off.
+Solver_Result solve_level_weighted(Solver_Level *level, Solver_Options *options, int weight, int bound)
+{
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    double start = solver_seconds();
+
+    Transposition_Table table;
+    if (!init_solver_table(&table, options)) {
+        result.gave_up = true;
+        return result;
+    }
+
+    Solver solver;
+    init_solver(&solver, level, &table, options);
+
+    int *boxes = malloc(sizeof(int) * (level->box_count + 1));
+    memcpy(boxes, level->start_boxes, sizeof(int) * level->box_count);
+    qsort(boxes, level->box_count, sizeof(int), compare_ints);
+
+    unsigned long long root_hash = hash_boxes(level, boxes);
+    int root_player = flood_player(&solver, boxes, level->start_player);
+    solver.start_symmetry = canonical_symmetry(&solver, boxes, &root_hash, &root_player);
+    turn_boxes(level, solver.start_symmetry, boxes);
+
+    int root = add_node(&solver, root_hash, boxes, root_player);
+    solver.nodes[root].symmetry = solver.start_symmetry;
+    solver.nodes[root].parent = -1;
+    solver.nodes[root].g = 0;
+    solver.nodes[root].f = weighted_f(0, lower_bound(&solver, boxes), weight);
+    solver.nodes[root].box_from = -1;
+    solver.nodes[root].direction = 0;
+
+    transposition_insert(&table, node_hash(&solver, root), 0, root, &solver.table_stats);
+
+    if (solver.nodes[root].f < SOLVER_INFINITY) heap_push(&solver, root);
+    result.nodes_generated = 1;
+
+    while (solver.heap_count > 0)
+    {
+        Heap_Entry entry = heap_pop(&solver);
+        int node = entry.node;
+
+        // A cheaper path to this node was found after this entry went in.
+        if (entry.g != solver.nodes[node].g) continue;
+
+        boxes_of(&solver, node, boxes);
+
+        if (is_solved_position(level, boxes)) {
+            result.solved = true;
+            build_solution(&solver, node, &result);
+            break;
+        }
+
+        if (options->max_nodes && result.nodes_expanded >= options->max_nodes) {
+            result.gave_up = true;
+            break;
+        }
+
+        if (options->time_limit > 0 && (result.nodes_expanded & 1023) == 0 && solver_seconds() - start > options->time_limit) {
+            result.gave_up = true;
+            break;
+        }
+
+        if (solver_cancelled(options)) {
+            result.gave_up = true;
+            break;
+        }
+
+        result.nodes_expanded += 1;
+
+        int g = solver.nodes[node].g;
+        int push_count = generate_pushes(&solver, boxes, solver.nodes[node].player);
+        lower_bound(&solver, boxes);
+
+        for (int p = 0; p < push_count; p += 1)
+        {
+            int b = solver.push_box[p];
+            int d = solver.push_direction[p];
+            int from = boxes[b];
+
+            int to, player, pushes;
+            int macro = carry_push(&solver, boxes, b, d, &to, &player, &pushes);
+
+            int *child_boxes = solver.child_boxes;
+            memcpy(child_boxes, boxes, sizeof(int) * level->box_count);
+            child_boxes[b] = to;
+            resort_box(child_boxes, level->box_count, b);
+
+            if (push_deadlocked_child(&solver, child_boxes, to)) continue;
+
+            int h = child_lower_bound(&solver, boxes, b, to);
+            if (h == SOLVER_INFINITY || g + pushes + h >= bound) continue;
+
+            // One box moved, so the hash changes by two XORs.
+            unsigned long long box_hash = solver.nodes[node].box_hash ^ level->box_keys[from] ^ level->box_keys[to];
+
+            player = flood_player_after_push(&solver, solver.parent_reach, child_boxes, from, to, player, macro);
+            int symmetry = canonical_symmetry(&solver, child_boxes, &box_hash, &player);
+            turn_boxes(level, symmetry, child_boxes);
+
+            int known_g;
+            int child = find_position(&solver, box_hash, child_boxes, player, &known_g);
+
+            if (child != -1 && known_g <= g + pushes) continue;
+
+            if (child == -1) child = add_node(&solver, box_hash, child_boxes, player);
+            transposition_insert(&table, box_hash ^ level->player_keys[player], g + pushes, child, &solver.table_stats);
+
+            solver.nodes[child].parent = node;
+            solver.nodes[child].g = g + pushes;
+            solver.nodes[child].f = weighted_f(g + pushes, h, weight);
+            solver.nodes[child].box_from = from;
+            solver.nodes[child].direction = d;
+            solver.nodes[child].macro = macro;
+            solver.nodes[child].symmetry = level->symmetry.compose[symmetry][solver.nodes[node].symmetry];
+
+            heap_push(&solver, child);
+            result.nodes_generated += 1;
+        }
+    }
+
+    result.table = solver.table_stats;
+    result.table_bytes = table.bytes;
+    result.table_load = transposition_load(&table, solver.table_stats.claimed);
+    result.deadlocks = solver.deadlock_stats;
+    result.reach_updates = solver.reach.updates;
+    result.reach_splits = solver.reach.splits;
+    result.reach_fills = solver.reach.fills;
+    result.tunnel_runs = solver.tunnel_runs;
+    result.room_fills = solver.room_fills;
+
+    free(boxes);
+    free_solver(&solver);
+    free_transposition_table(&table);
+
+    result.seconds = solver_seconds() - start;
+    return result;
+}
+
+Solver_Result solve_level(Solver_Level *level, Solver_Options *options)
+{
+    return solve_level_weighted(level, options, 100, SOLVER_INFINITY);
+}
+
+void free_solver_result(Solver_Result *result)
+{
+    free(result->moves);
+    result->moves = NULL;
+}
+
+// The parallel search takes its moves from ida.c.
+#include "ida.c"
+#include "parallel.c"
+#include "bidirectional.c"
+#include "external.c"
+#include "anytime.c"
+#include "portfolio.c"
+
+Solver_Result solve_board(Board *board, Solver_Options *options)
+{
+    Solver_Level level;
+    Solver_Result result;
+    memset(&result, 0, sizeof(result));
+
+    if (make_solver_level(board, &level)) {
+        prepare_patterns(&level, options);
+
+        // Planning the goal rooms is a search of its own, so only when they are wanted.
+        if (options->macros) {
+            build_macro_level(&level.macros, level.cells, level.cell_count, level.offsets, level.deadlock.dead,
+                              level.start_boxes, level.box_count);
+        }
+
+        if (options->portfolio) result = solve_level_portfolio(&level, options);
+        else if (options->external) result = solve_level_external(&level, options);
+        else if (options->ida) result = solve_level_ida(&level, options);
+        else if (options->bidirectional) result = solve_level_bidirectional(&level, options);
+        else if (options->anytime) result = solve_level_anytime(&level, options);
+        else if (options->threads > 0) result = solve_level_parallel(&level, options);
+        else result = solve_level(&level, options);
+
+        result.live_cells = level.encoding.live_count;
+        result.state_bytes = level.encoding.state_bytes;
+        result.tunnel_cells = level.macros.tunnel_cells;
+        result.goal_rooms = level.macros.room_count;
+        if (!options->ignore_symmetry && !options->bidirectional && !options->external) result.symmetries = level.symmetry.count;
+        result.pattern_groups = level.patterns.group_count;
+        result.pattern_boxes = level.patterns.group_size;
+        result.pattern_bytes = level.patterns.table_bytes;
+        result.pattern_seconds = level.patterns.build_seconds;
+        result.patterns_cached = level.patterns.from_cache;
+    }
+
+    free_solver_level(&level);
+    return result;
+}
@@ -0,0 +1,144 @@
+//
+// Compact box sets for the searches to store.
+//
+// Boxes only ever stand on live cells: floor the player can get to from the
+// start, and when every box is needed on a goal, only floor a box can still
+// reach a goal from. The live cells are numbered, and a box set is stored
+// as whichever is smaller for the level: a bitset over the live cells, or
+// the sorted live numbers in one, two or four bytes each. Both are
+// canonical, one byte string per box set, so positions compare with memcmp.
+//
+// The player is not in here. The searches keep the smallest cell of the
+// player's region next to the boxes, which already makes every position
+// the player can walk between the same one.
+//
+
+#include <assert.h>
+
+typedef struct {
+    // Live number per cell, -1 for cells a box never stands on.
+    int *live_index;
+    int *live_cells;
+    int live_count;
+
+    // Bytes per live number, or 0 for the bitset.
+    int index_bytes;
+    int state_bytes;
+} State_Encoding;
+
+void build_state_encoding(State_Encoding *encoding, unsigned char *cells, int cell_count, int *offsets,
+                          int start_player, int *start_boxes, int box_count, int *nearest_goal, bool spare_boxes)
+{
+    memset(encoding, 0, sizeof(*encoding));
+    encoding->live_index = malloc(sizeof(int) * cell_count);
+    encoding->live_cells = malloc(sizeof(int) * cell_count);
+    int *queue = malloc(sizeof(int) * cell_count);
+
+    for (int c = 0; c < cell_count; c += 1) encoding->live_index[c] = -1;
+
+    // Every floor cell the player could reach with the boxes out of the way, marked with -2 for now.
+    int head = 0, tail = 0;
+    encoding->live_index[start_player] = -2;
+    queue[tail++] = start_player;
+
+    while (head < tail)
+    {
+        int cell = queue[head++];
+
+        for (int d = 0; d < 4; d += 1)
+        {
+            int next = cell + offsets[d];
+            if ((cells[next] & SOLVER_WALL) || encoding->live_index[next] != -1) continue;
+
+            encoding->live_index[next] = -2;
+            queue[tail++] = next;
+        }
+    }
+
+    // A box can be anywhere it starts, even somewhere that already lost the level.
+    bool *start = calloc(cell_count, sizeof(bool));
+    for (int b = 0; b < box_count; b += 1) start[start_boxes[b]] = true;
+
+    for (int c = 0; c < cell_count; c += 1)
+    {
+        bool reached = encoding->live_index[c] == -2 || start[c];
+        bool dead = !spare_boxes && nearest_goal[c] >= SOLVER_INFINITY && !start[c];
+
+        encoding->live_index[c] = -1;
+        if (!reached || dead) continue;
+
+        encoding->live_index[c] = encoding->live_count;
+        encoding->live_cells[encoding->live_count++] = c;
+    }
+
+    free(start);
+    free(queue);
+
+    int index_bytes = encoding->live_count <= 0x100 ? 1 : encoding->live_count <= 0x10000 ? 2 : 4;
+    int bitset_bytes = (encoding->live_count + 7) / 8;
+
+    if (bitset_bytes <= index_bytes * box_count) {
+        encoding->index_bytes = 0;
+        encoding->state_bytes = bitset_bytes;
+    } else {
+        encoding->index_bytes = index_bytes;
+        encoding->state_bytes = index_bytes * box_count;
+    }
+
+    // Never zero, so every state has an address of its own.
+    if (encoding->state_bytes == 0) encoding->state_bytes = 1;
+}
+
+void free_state_encoding(State_Encoding *encoding)
+{
+    free(encoding->live_index);
+    free(encoding->live_cells);
+    memset(encoding, 0, sizeof(*encoding));
+}
+
+// `boxes` has to be sorted by cell, which sorts the live numbers too.
+void encode_boxes(State_Encoding *encoding, int *boxes, int box_count, unsigned char *out)
+{
+    memset(out, 0, encoding->state_bytes);
+
+    for (int b = 0; b < box_count; b += 1)
+    {
+        // A box on a dead cell has no live number, and would be written anywhere.
+        assert(encoding->live_index[boxes[b]] >= 0);
+        unsigned int index = (unsigned int)encoding->live_index[boxes[b]];
+
+        if (encoding->index_bytes == 0) {
+            out[index >> 3] |= (unsigned char)(1 << (index & 7));
+            continue;
+        }
+
+        for (int byte = 0; byte < encoding->index_bytes; byte += 1)
+        {
+            out[b * encoding->index_bytes + byte] = (unsigned char)(index >> ((encoding->index_bytes - 1 - byte) * 8));
+        }
+    }
+}
+
+void decode_boxes(State_Encoding *encoding, unsigned char *in, int box_count, int *boxes)
+{
+    if (encoding->index_bytes == 0) {
+        int b = 0;
+        for (int byte = 0; byte < encoding->state_bytes && b < box_count; byte += 1)
+        {
+            for (int bits = in[byte]; bits; bits &= bits - 1)
+            {
+                int bit = 0;
+                while (!(bits & (1 << bit))) bit += 1;
+                boxes[b++] = encoding->live_cells[byte * 8 + bit];
+            }
+        }
+        return;
+    }
+
+    for (int b = 0; b < box_count; b += 1)
+    {
+        unsigned int index = 0;
+        for (int byte = 0; byte < encoding->index_bytes; byte += 1) index = (index << 8) | in[b * encoding->index_bytes + byte];
+        boxes[b] = encoding->live_cells[index];
+    }
+}
@@ -0,0 +1,206 @@
+//
+// Stuck boxes: the deadlock check the game runs after every push.
+//
+// It only looks at the box that just moved and its neighbours, and gives up
+// rather than read past a fixed number of tiles, so a push costs the same on
+// a huge board as on a small one. Giving up counts as not stuck: the warning
+// can miss a deadlock, but it never calls a position that can still be won
+// lost.
+//
+// Cheapest first:
+//
+//     dead square  the box is off goal in a corner, or against a wall that
+//                  runs corner to corner with no goal on it and no gap in it
+//     2x2          the box is one of four boxes and walls in a square
+//     freeze       the box can not move along either axis, because of walls,
+//                  dead corners, or other boxes that can not move either
+//
+// Stuck boxes get TILE_STUCK, which render_game draws in red. A stuck box
+// never becomes unstuck, so nothing clears the flag but moving the box:
+// set_box drops it, and the check after the push sets it again if it still
+// applies.
+//
+// A level with more boxes than goals is never checked: any of its boxes
+// might be one that stays off goal.
+//
+
+// Tiles walked each way along a wall before the dead square check gives up.
+#define STUCK_LINE_BUDGET 32
+
+// Boxes the freeze check looks at before it gives up.
+#define STUCK_FREEZE_BUDGET 16
+
+typedef struct {
+    Board_Cursor *cursor;
+
+    // Boxes found frozen so far, or still being looked at. Both count as wall.
+    int i[STUCK_FREEZE_BUDGET];
+    int j[STUCK_FREEZE_BUDGET];
+    int count;
+} Stuck_Check;
+
+bool stuck_wall(Board_Cursor *cursor, int i, int j)
+{
+    return tile_type(read_tile(cursor, i, j)) == WALL;
+}
+
+// A floor tile with wall on two sides that meet. A box there can never move again.
+bool stuck_dead_corner(Board_Cursor *cursor, int i, int j)
+{
+    if (tile_type(read_tile(cursor, i, j)) != FLOOR) return false;
+
+    bool vertical = stuck_wall(cursor, i-1, j) || stuck_wall(cursor, i+1, j);
+    bool horizontal = stuck_wall(cursor, i, j-1) || stuck_wall(cursor, i, j+1);
+    return vertical && horizontal;
+}
+
+// With the wall at offset (wall_i, wall_j) from (i, j), walks along it both ways. A box can only
+// slide along that wall, so it is lost if both ends are corners and there is no goal in between.
+bool stuck_dead_wall(Board_Cursor *cursor, int i, int j, int wall_i, int wall_j)
+{
+    for (int side = -1; side <= 1; side += 2)
+    {
+        int step_i = wall_j * side;
+        int step_j = wall_i * side;
+
+        for (int n = 1; ; n += 1)
+        {
+            if (n > STUCK_LINE_BUDGET) return false;
+
+            int at_i = i + step_i * n;
+            int at_j = j + step_j * n;
+            Tile tile = read_tile(cursor, at_i, at_j);
+
+            if (tile_type(tile) == WALL) break;
+            if (tile_type(tile) == GOAL) return false;
+
+            // A gap in the wall is somewhere the box can be pushed off it.
+            if (!stuck_wall(cursor, at_i + wall_i, at_j + wall_j)) return false;
+        }
+    }
+
+    return true;
+}
+
+bool stuck_dead_square(Board_Cursor *cursor, int i, int j)
+{
+    if (tile_type(read_tile(cursor, i, j)) == GOAL) return false;
+    if (stuck_dead_corner(cursor, i, j)) return true;
+
+    if (stuck_wall(cursor, i-1, j) && stuck_dead_wall(cursor, i, j, -1, 0)) return true;
+    if (stuck_wall(cursor, i+1, j) && stuck_dead_wall(cursor, i, j, 1, 0)) return true;
+    if (stuck_wall(cursor, i, j-1) && stuck_dead_wall(cursor, i, j, 0, -1)) return true;
+    if (stuck_wall(cursor, i, j+1) && stuck_dead_wall(cursor, i, j, 0, 1)) return true;
+
+    return false;
+}
+
+bool stuck_box_frozen(Stuck_Check *check, int i, int j);
+
+// Whether the box on (i, j) can not be pushed either way along the axis (di, dj).
+bool stuck_axis_blocked(Stuck_Check *check, int i, int j, int di, int dj)
+{
+    Tile before = read_tile(check->cursor, i - di, j - dj);
+    Tile after = read_tile(check->cursor, i + di, j + dj);
+
+    if (tile_type(before) == WALL || tile_type(after) == WALL) return true;
+
+    // It could move, but only into a corner it never leaves.
+    if (stuck_dead_corner(check->cursor, i - di, j - dj) && stuck_dead_corner(check->cursor, i + di, j + dj)) return true;
+
+    if (tile_has_box(before) && stuck_box_frozen(check, i - di, j - dj)) return true;
+    if (tile_has_box(after) && stuck_box_frozen(check, i + di, j + dj)) return true;
+
+    return false;
+}
+
+bool stuck_box_frozen(Stuck_Check *check, int i, int j)
+{
+    for (int b = 0; b < check->count; b += 1)
+    {
+        if (check->i[b] == i && check->j[b] == j) return true;
+    }
+
+    if (check->count == STUCK_FREEZE_BUDGET) return false;
+
+    int mark = check->count;
+    check->i[check->count] = i;
+    check->j[check->count] = j;
+    check->count += 1;
+
+    if (stuck_axis_blocked(check, i, j, 0, 1) && stuck_axis_blocked(check, i, j, 1, 0)) return true;
+
+    // Not frozen, so neither is anything that was only frozen because this box was taken as wall.
+    check->count = mark;
+    return false;
+}
+
+void mark_stuck(Board_Cursor *cursor, int i, int j)
+{
+    Tile *tile = write_tile(cursor, i, j);
+    if (tile_is_stuck(*tile)) return;
+
+    *tile |= TILE_STUCK;
+    cursor->board->stuck_boxes += 1;
+}
+
+// Run after a push leaves a box on (i, j). Returns true, and marks the boxes, when that push lost the level.
+bool check_stuck_box(Board_Cursor *cursor, int i, int j)
+{
+    if (cursor->board->spare_boxes > 0) return false;
+
+    if (stuck_dead_square(cursor, i, j)) {
+        mark_stuck(cursor, i, j);
+        return true;
+    }
+
+    // The four squares the box is a corner of.
+    for (int square_i = i-1; square_i <= i; square_i += 1)
+    {
+        for (int square_j = j-1; square_j <= j; square_j += 1)
+        {
+            bool closed = true;
+            bool off_goal = false;
+
+            for (int n = 0; n < 4 && closed; n += 1)
+            {
+                Tile tile = read_tile(cursor, square_i + (n >> 1), square_j + (n & 1));
+                closed = tile_type(tile) == WALL || tile_has_box(tile);
+                if (tile_has_box(tile) && tile_type(tile) != GOAL) off_goal = true;
+            }
+
+            if (!closed || !off_goal) continue;
+
+            for (int n = 0; n < 4; n += 1)
+            {
+                if (tile_has_box(read_tile(cursor, square_i + (n >> 1), square_j + (n & 1)))) {
+                    mark_stuck(cursor, square_i + (n >> 1), square_j + (n & 1));
+                }
+            }
+
+            return true;
+        }
+    }
+
+    Stuck_Check check;
+    check.cursor = cursor;
+    check.count = 0;
+
+    if (!stuck_box_frozen(&check, i, j)) return false;
+
+    // Frozen boxes that are all on goals are just finished.
+    bool off_goal = false;
+    for (int b = 0; b < check.count; b += 1)
+    {
+        if (tile_type(read_tile(cursor, check.i[b], check.j[b])) != GOAL) off_goal = true;
+    }
+
+    if (!off_goal) return false;
+
+    for (int b = 0; b < check.count; b += 1)
+    {
+        mark_stuck(cursor, check.i[b], check.j[b]);
+    }
+
+    return true;
+}
@@ -0,0 +1,173 @@
+//
+// Symmetries of a level: the turns and mirror images of its grid that
+// leave the walls and goals where they were.
+//
+// A position and its image under one of them are the same problem, so the
+// search only needs one of the two. Positions go in the table as their
+// image with the smallest key, and a node keeps the image it was stored as
+// and the symmetry that took the real position there. Its pushes are in
+// its parent's image, so build_moves turns them back before playing them.
+//
+// The eight are a turn about the grid's diagonal, then a flip of its rows,
+// then one of its columns, the three bits of a symmetry's kind. The turn
+// needs a square grid. The cells a box can be on have to map onto each
+// other as well, so every image has a state encoding, see state.c.
+//
+// The key of an image names the player's region by its smallest cell, like
+// any other. That cell is at an edge of the region, the first or last row
+// and then the first or last column, so it comes off the bitboard of the
+// region without turning every cell of it.
+//
+// Works on the solver's cell layout, like deadlock.c.
+//
+
+#define SYMMETRY_MAX 8
+#define SYMMETRY_DIAGONAL 1
+#define SYMMETRY_FLIP_ROWS 2
+#define SYMMETRY_FLIP_COLUMNS 4
+
+typedef struct {
+    // The level's symmetries, the identity first. map[s][cell] is where s takes a cell and
+    // directions[s][d] where it takes a Direction.
+    int count;
+    int kind[SYMMETRY_MAX];
+    int *map[SYMMETRY_MAX];
+    int directions[SYMMETRY_MAX][4];
+
+    // compose[a][b] is b and then a, and inverse[a] undoes a.
+    int compose[SYMMETRY_MAX][SYMMETRY_MAX];
+    int inverse[SYMMETRY_MAX];
+} Symmetry_Level;
+
+int symmetric_cell(int kind, int w, int h, int cell)
+{
+    int i = cell / w;
+    int j = cell % w;
+
+    if (kind & SYMMETRY_DIAGONAL) {
+        int swap = i;
+        i = j;
+        j = swap;
+    }
+    if (kind & SYMMETRY_FLIP_ROWS) i = h - 1 - i;
+    if (kind & SYMMETRY_FLIP_COLUMNS) j = w - 1 - j;
+
+    return i * w + j;
+}
+
+// `live` is the state encoding's index per cell, -1 where a box can not be.
+void build_symmetry_level(Symmetry_Level *symmetry, unsigned char *cells, int w, int h, int *offsets, int *live)
+{
+    memset(symmetry, 0, sizeof(*symmetry));
+    int cell_count = w * h;
+
+    for (int kind = 0; kind < SYMMETRY_MAX; kind += 1)
+    {
+        if ((kind & SYMMETRY_DIAGONAL) && w != h) continue;
+
+        bool same = true;
+        for (int c = 0; c < cell_count && same; c += 1)
+        {
+            int image = symmetric_cell(kind, w, h, c);
+            if ((cells[c] ^ cells[image]) & (SOLVER_WALL | SOLVER_GOAL)) same = false;
+            if ((live[c] == -1) != (live[image] == -1)) same = false;
+        }
+        if (!same) continue;
+
+        int s = symmetry->count++;
+        symmetry->kind[s] = kind;
+        symmetry->map[s] = malloc(sizeof(int) * cell_count);
+        for (int c = 0; c < cell_count; c += 1) symmetry->map[s][c] = symmetric_cell(kind, w, h, c);
+
+        // Any cell with room round it shows where a step goes.
+        int middle = w + 1;
+        for (int d = 0; d < 4; d += 1)
+        {
+            int step = symmetry->map[s][middle + offsets[d]] - symmetry->map[s][middle];
+            for (int e = 0; e < 4; e += 1) if (offsets[e] == step) symmetry->directions[s][d] = e;
+        }
+    }
+
+    // The symmetries of anything are closed under both, so every answer is among them.
+    for (int a = 0; a < symmetry->count; a += 1)
+    {
+        for (int b = 0; b < symmetry->count; b += 1)
+        {
+            for (int s = 0; s < symmetry->count; s += 1)
+            {
+                bool same = true;
+                for (int c = 0; c < cell_count && same; c += 1)
+                {
+                    if (symmetry->map[s][c] != symmetry->map[a][symmetry->map[b][c]]) same = false;
+                }
+
+                if (same) symmetry->compose[a][b] = s;
+            }
+
+            if (symmetry->compose[a][b] == 0) symmetry->inverse[a] = b;
+        }
+    }
+}
+
+void free_symmetry_level(Symmetry_Level *symmetry)
+{
+    for (int s = 0; s < symmetry->count; s += 1) free(symmetry->map[s]);
+    memset(symmetry, 0, sizeof(*symmetry));
+}
+
+// The first or last row with a cell of `bits` in it, in `column` or in any column for -1.
+int extreme_row(Bitboard_Level *level, Bitboard_Word *bits, int column, bool last)
+{
+    for (int step = 0; step < level->h; step += 1)
+    {
+        int row = last ? level->h - 1 - step : step;
+
+        if (column >= 0) {
+            if (bitboard_test(level, bits, row * level->w + column)) return row;
+            continue;
+        }
+
+        for (int word = 0; word < level->row_words; word += 1) if (bits[row * level->row_words + word]) return row;
+    }
+
+    return -1;
+}
+
+// The first or last column with a cell of `bits` in it, in `row` or in any row for -1.
+int extreme_column(Bitboard_Level *level, Bitboard_Word *bits, int row, bool last)
+{
+    for (int step = 0; step < level->row_words; step += 1)
+    {
+        int word = last ? level->row_words - 1 - step : step;
+
+        Bitboard_Word column_bits = 0;
+        if (row >= 0) {
+            column_bits = bits[row * level->row_words + word];
+        } else {
+            for (int r = 0; r < level->h; r += 1) column_bits |= bits[r * level->row_words + word];
+        }
+
+        if (column_bits) return word * 64 + (last ? highest_bit(column_bits) : lowest_bit(column_bits));
+    }
+
+    return -1;
+}
+
+// The smallest of the images of the cells of `bits`, which must have one, under a symmetry of this kind.
+int symmetric_smallest_cell(Bitboard_Level *level, Bitboard_Word *bits, int kind)
+{
+    bool flip_rows = (kind & SYMMETRY_FLIP_ROWS) != 0;
+    bool flip_columns = (kind & SYMMETRY_FLIP_COLUMNS) != 0;
+    int row, column;
+
+    if (kind & SYMMETRY_DIAGONAL) {
+        // The image's rows are the columns, and its columns the rows.
+        column = extreme_column(level, bits, -1, flip_rows);
+        row = extreme_row(level, bits, column, flip_columns);
+    } else {
+        row = extreme_row(level, bits, -1, flip_rows);
+        column = extreme_column(level, bits, row, flip_columns);
+    }
+
+    return symmetric_cell(kind, level->w, level->h, row * level->w + column);
+}
@@ -0,0 +1,7 @@
+@echo off
+
+pushd bin
+solve.exe --expect-unsolvable ..\assets\tests\sealed_goals.txt && solve.exe --bidirectional --expect-unsolvable ..\assets\tests\sealed_goals.txt
+set failed=%errorlevel%
+popd
+exit /b %failed%
@@ -0,0 +1,217 @@
+//
+// Transposition table: a fixed amount of memory that remembers which
+// positions have been seen, at what cost, and where they are stored.
+//
+// Every entry is two 64-bit words, the key (the position's hash, 0 for an
+// empty entry) and the value:
+//
+//     bits  0..31  node, the caller's reference to where the position lives
+//     bits 32..47  g, pushes from the start
+//     bits 48..63  check, a fragment of the key
+//
+// Entries come in buckets of four, one cache line, and a hash only ever
+// looks in its own bucket. Both words are only changed with compare and
+// swap, so any number of threads can insert and look up at once without a
+// lock. The two words are not changed together, so a reader can catch an
+// entry halfway through being replaced; the check fragment in the value
+// tells it the value does not belong to the key it read, and it counts as
+// a miss. Losing an entry that way, or to replacement, only costs a
+// re-expansion: callers still have to confirm a hit against the real
+// position before trusting it.
+//
+// When a bucket is full the entry with the largest g is replaced. Entries
+// near the start guard the biggest subtrees, so they are the ones worth
+// keeping.
+//
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define compare_and_swap_64(target, expected, desired) \
+    (_InterlockedCompareExchange64((volatile long long *)(target), (long long)(desired), (long long)(expected)) == (long long)(expected))
+// Volatile reads of aligned 64-bit words are atomic and ordered on x64 with MSVC.
+#define load_64(source) (*(source))
+#else
+#define compare_and_swap_64(target, expected, desired) \
+    __sync_bool_compare_and_swap((target), (expected), (desired))
+#define load_64(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#endif
+
+#define TRANSPOSITION_BUCKET 4
+#define TRANSPOSITION_MAX_G 0xffff
+
+typedef struct {
+    volatile unsigned long long key;
+    volatile unsigned long long value;
+} Transposition_Entry;
+
+typedef struct {
+    Transposition_Entry *entries;
+    unsigned long long bucket_mask;
+    long long bytes;
+} Transposition_Table;
+
+// Kept by each thread on its own so counting never contends.
+typedef struct {
+    // Empty entries this thread filled. Summed over threads it is how full the table is.
+    long long claimed;
+    long long inserts;
+    long long improvements;
+    long long duplicates;
+    long long replacements;
+    long long cas_failures;
+} Transposition_Stats;
+
+typedef enum {
+    TRANSPOSITION_NEW,
+    TRANSPOSITION_BETTER,
+    TRANSPOSITION_DUPLICATE,
+} Transposition_Outcome;
+
+unsigned long long transposition_key(unsigned long long hash)
+{
+    return hash ? hash : 1;
+}
+
+// Never zero, so an entry that has never had a value cannot pass the check.
+unsigned long long transposition_check(unsigned long long key)
+{
+    return (key >> 48) | 1;
+}
+
+unsigned long long make_transposition_value(unsigned long long key, int g, unsigned int node)
+{
+    if (g > TRANSPOSITION_MAX_G) g = TRANSPOSITION_MAX_G;
+    return (transposition_check(key) << 48) | ((unsigned long long)g << 32) | node;
+}
+
+#define transposition_value_g(value) ((int)(((value) >> 32) & 0xffff))
+#define transposition_value_node(value) ((unsigned int)(value))
+#define transposition_value_matches(value, key) (((value) >> 48) == transposition_check(key))
+
+// Takes the largest power of two number of buckets that fits in max_bytes.
+bool init_transposition_table(Transposition_Table *table, long long max_bytes)
+{
+    long long bucket_bytes = sizeof(Transposition_Entry) * TRANSPOSITION_BUCKET;
+    long long buckets = 1;
+    while (buckets * 2 * bucket_bytes <= max_bytes) buckets *= 2;
+
+    table->entries = calloc((size_t)buckets * TRANSPOSITION_BUCKET, sizeof(Transposition_Entry));
+    table->bucket_mask = (unsigned long long)buckets - 1;
+    table->bytes = buckets * bucket_bytes;
+
+    return table->entries != NULL;
+}
+
+void free_transposition_table(Transposition_Table *table)
+{
+    free(table->entries);
+    memset(table, 0, sizeof(*table));
+}
+
+Transposition_Entry *transposition_bucket(Transposition_Table *table, unsigned long long key)
+{
+    // The low bits of the hash pick the bucket. The high bits are the check, so they stay independent.
+    return &table->entries[(key & table->bucket_mask) * TRANSPOSITION_BUCKET];
+}
+
+bool transposition_lookup(Transposition_Table *table, unsigned long long hash, int *g, unsigned int *node)
+{
+    unsigned long long key = transposition_key(hash);
+    Transposition_Entry *bucket = transposition_bucket(table, key);
+
+    for (int e = 0; e < TRANSPOSITION_BUCKET; e += 1)
+    {
+        if (load_64(&bucket[e].key) != key) continue;
+
+        unsigned long long value = load_64(&bucket[e].value);
+        if (!transposition_value_matches(value, key)) return false;
+
+        *g = transposition_value_g(value);
+        *node = transposition_value_node(value);
+        return true;
+    }
+
+    return false;
+}
+
+// Puts the value in an entry that already holds the key, unless the entry has it at the same or lower g.
+Transposition_Outcome improve_transposition(Transposition_Entry *entry, unsigned long long key, unsigned long long value, Transposition_Stats *stats)
+{
+    for (;;)
+    {
+        unsigned long long old = load_64(&entry->value);
+        bool owned = transposition_value_matches(old, key);
+
+        if (owned && transposition_value_g(old) <= transposition_value_g(value)) {
+            stats->duplicates += 1;
+            return TRANSPOSITION_DUPLICATE;
+        }
+
+        if (compare_and_swap_64(&entry->value, old, value)) {
+            if (owned) stats->improvements += 1;
+            else stats->inserts += 1;
+            return owned ? TRANSPOSITION_BETTER : TRANSPOSITION_NEW;
+        }
+
+        stats->cas_failures += 1;
+    }
+}
+
+Transposition_Outcome transposition_insert(Transposition_Table *table, unsigned long long hash, int g, unsigned int node, Transposition_Stats *stats)
+{
+    unsigned long long key = transposition_key(hash);
+    unsigned long long value = make_transposition_value(key, g, node);
+    Transposition_Entry *bucket = transposition_bucket(table, key);
+
+    for (;;)
+    {
+        int victim = 0;
+        int victim_g = -1;
+        unsigned long long victim_key = 0;
+        bool retry = false;
+
+        for (int e = 0; e < TRANSPOSITION_BUCKET; e += 1)
+        {
+            unsigned long long entry_key = load_64(&bucket[e].key);
+            if (entry_key == key) return improve_transposition(&bucket[e], key, value, stats);
+
+            if (entry_key == 0) {
+                if (compare_and_swap_64(&bucket[e].key, 0ULL, key)) {
+                    stats->claimed += 1;
+                    return improve_transposition(&bucket[e], key, value, stats);
+                }
+
+                // Someone else took it, maybe for this same key. Look at the bucket again.
+                stats->cas_failures += 1;
+                retry = true;
+                break;
+            }
+
+            // A value that does not match its key is mid replacement, and the cheapest thing to lose.
+            unsigned long long entry_value = load_64(&bucket[e].value);
+            int entry_g = transposition_value_matches(entry_value, entry_key) ? transposition_value_g(entry_value) : TRANSPOSITION_MAX_G + 1;
+
+            if (entry_g > victim_g) {
+                victim = e;
+                victim_g = entry_g;
+                victim_key = entry_key;
+            }
+        }
+
+        if (retry) continue;
+
+        if (compare_and_swap_64(&bucket[victim].key, victim_key, key)) {
+            stats->replacements += 1;
+            return improve_transposition(&bucket[victim], key, value, stats);
+        }
+
+        stats->cas_failures += 1;
+    }
+}
+
+// Share of entries in use, given the claimed counts of every thread added up.
+double transposition_load(Transposition_Table *table, long long claimed)
+{
+    long long entry_count = (long long)(table->bucket_mask + 1) * TRANSPOSITION_BUCKET;
+    return (double)claimed / entry_count;
+}